@@ -0,0 +1,105 @@
+/*
+ * nooice - ...
+ * Copyright (C) 2016-2017 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef NOOICE_ARENA_HPP_INCLUDED
+#define NOOICE_ARENA_HPP_INCLUDED
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+// --------------------------------------------------------------------------------------------------------------------
+// Per-instance state sized at init, carved out of a single cache-line aligned block
+// Every allocation starts on its own cache line, so that arrays owned by different threads never share one.
+// Memory is only released with the arena, there is no way to free single allocations.
+
+class Arena {
+public:
+    static const size_t kAlignment = 64;
+
+    Arena() noexcept
+        : data(nullptr),
+          size(0),
+          used(0) {}
+
+    ~Arena()
+    {
+        std::free(data);
+    }
+
+    // bytes taken by an allocation of count T, for sizing the arena before reserve()
+    template <typename T>
+    static size_t getSize(const size_t count) noexcept
+    {
+        return (sizeof(T) * count + kAlignment - 1) & ~(kAlignment - 1);
+    }
+
+    // allocate the block, once, before any allocate() or create()
+    bool reserve(const size_t bytes) noexcept
+    {
+        if (data != nullptr)
+            return false;
+        if (bytes == 0)
+            return true;
+
+        void* ptr;
+        if (posix_memalign(&ptr, kAlignment, bytes) != 0)
+            return false;
+
+        std::memset(ptr, 0, bytes);
+        data = static_cast<unsigned char*>(ptr);
+        size = bytes;
+        return true;
+    }
+
+    // zero-initialized array of trivial types, nullptr if the reserved size is exceeded
+    template <typename T>
+    T* allocate(const size_t count) noexcept
+    {
+        const size_t bytes = getSize<T>(count);
+
+        if (size - used < bytes)
+            return nullptr;
+
+        T* const ptr = reinterpret_cast<T*>(data + used);
+        used += bytes;
+        return ptr;
+    }
+
+    // single object, default-constructed, nullptr if the reserved size is exceeded
+    // Destructors are never called, so T must not own anything.
+    template <typename T>
+    T* create() noexcept
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+
+        void* const ptr = allocate<T>(1);
+        return ptr != nullptr ? new (ptr) T() : nullptr;
+    }
+
+private:
+    unsigned char* data;
+    size_t size;
+    size_t used;
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+#endif // NOOICE_ARENA_HPP_INCLUDED
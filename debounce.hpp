@@ -0,0 +1,181 @@
+/*
+ * nooice - ...
+ * Copyright (C) 2016-2017 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef NOOICE_DEBOUNCE_HPP_INCLUDED
+#define NOOICE_DEBOUNCE_HPP_INCLUDED
+
+#include <cstring>
+#include <stdint.h>
+
+#include <jack/types.h>
+
+// --------------------------------------------------------------------------------------------------------------------
+// Debounce for digital buttons, run by the reader thread on every report with its frame time
+// Eager mode takes a change right away, then ignores that button for the hold time.
+// Deferred mode takes a change only once the button kept its new state for the hold time, which adds that much
+// latency but also filters single glitches.
+// State is kept as bitsets, buttons that did not change and are not waiting on anything cost nothing.
+
+struct Debounce {
+    static const unsigned kMaxButtons = 256;
+    static const unsigned kWords = kMaxButtons / 32;
+
+    jack_nframes_t hold; // 0 when disabled
+    bool deferred;
+
+    // debounced state
+    uint32_t stable[kWords];
+
+    Debounce() noexcept
+        : hold(0),
+          deferred(false)
+    {
+        std::memset(stable, 0, sizeof(stable));
+        std::memset(input, 0, sizeof(input));
+        std::memset(waiting, 0, sizeof(waiting));
+        std::memset(since, 0, sizeof(since));
+    }
+
+    // if a change is held back, update() needs to be called again after the hold time even without new input
+    bool isWaiting() const noexcept
+    {
+        for (unsigned i=0; i<kWords; ++i)
+        {
+            if ((deferred ? waiting[i] : waiting[i] & (input[i] ^ stable[i])) != 0)
+                return true;
+        }
+
+        return false;
+    }
+
+    // frames left until the first held back change can be taken, 0 if one already can
+    jack_nframes_t remaining(const jack_nframes_t time) const noexcept
+    {
+        jack_nframes_t result = hold;
+
+        for (unsigned i=0; i<kWords; ++i)
+        {
+            const uint32_t mask = deferred ? waiting[i] : waiting[i] & (input[i] ^ stable[i]);
+
+            for (uint32_t bits = mask; bits != 0; bits &= bits - 1)
+            {
+                const jack_nframes_t elapsed = time - since[i*32 + __builtin_ctz(bits)];
+
+                if (elapsed >= hold)
+                    return 0;
+                if (hold - elapsed < result)
+                    result = hold - elapsed;
+            }
+        }
+
+        return result;
+    }
+
+    void setButton(const unsigned index, const bool pressed) noexcept
+    {
+        if (pressed)
+            input[index / 32] |= 1u << (index % 32);
+        else
+            input[index / 32] &= ~(1u << (index % 32));
+    }
+
+    void setByte(const unsigned index, const unsigned char value) noexcept
+    {
+        uint32_t& word(input[index / 4]);
+        const unsigned shift = (index % 4) * 8;
+
+        word = (word & ~(0xFFu << shift)) | (uint32_t(value) << shift);
+    }
+
+    unsigned char getByte(const unsigned index) const noexcept
+    {
+        return stable[index / 4] >> ((index % 4) * 8);
+    }
+
+    // with the buttons set since the last call, returns true if the debounced state changed
+    bool update(const jack_nframes_t time) noexcept
+    {
+        bool changed = false;
+
+        for (unsigned i=0; i<kWords; ++i)
+        {
+            const uint32_t diff = input[i] ^ stable[i];
+
+            if ((diff | waiting[i]) == 0)
+                continue;
+
+            uint32_t accepted;
+
+            if (deferred)
+            {
+                // new candidates start their hold time now, those back at their stable state are dropped
+                for (uint32_t bits = diff & ~waiting[i]; bits != 0; bits &= bits - 1)
+                    since[i*32 + __builtin_ctz(bits)] = time;
+
+                waiting[i] = diff;
+                accepted = expired(i, diff, time);
+                waiting[i] &= ~accepted;
+            }
+            else
+            {
+                // locked buttons whose hold time is over can change again
+                waiting[i] &= ~expired(i, waiting[i], time);
+
+                accepted = diff & ~waiting[i];
+
+                for (uint32_t bits = accepted; bits != 0; bits &= bits - 1)
+                    since[i*32 + __builtin_ctz(bits)] = time;
+
+                waiting[i] |= accepted;
+            }
+
+            if (accepted != 0)
+            {
+                stable[i] ^= accepted;
+                changed = true;
+            }
+        }
+
+        return changed;
+    }
+
+private:
+    // last input
+    uint32_t input[kWords];
+
+    // eager: buttons locked after a change, deferred: buttons with a new state waiting to be taken
+    uint32_t waiting[kWords];
+    jack_nframes_t since[kMaxButtons];
+
+    uint32_t expired(const unsigned word, const uint32_t mask, const jack_nframes_t time) const noexcept
+    {
+        uint32_t result = 0;
+
+        for (uint32_t bits = mask; bits != 0; bits &= bits - 1)
+        {
+            const unsigned bit = __builtin_ctz(bits);
+
+            if (time - since[word*32 + bit] >= hold)
+                result |= 1u << bit;
+        }
+
+        return result;
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+#endif // NOOICE_DEBOUNCE_HPP_INCLUDED
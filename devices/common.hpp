@@ -17,13 +17,33 @@
 #ifndef NOOICE_COMMON_HPP_INCLUDED
 #define NOOICE_COMMON_HPP_INCLUDED
 
+#include <cstring>
+
 #include <pthread.h>
+#include <stdint.h>
 
 #include <jack/jack.h>
 #include <jack/midiport.h>
 
+#include "../arena.hpp"
+#include "../debounce.hpp"
+#include "../governor.hpp"
+#include "../midiqueue.hpp"
+#include "../midiwriter.hpp"
+#include "../motion.hpp"
+#include "../osc.hpp"
+#include "../polar.hpp"
+#include "../recorder.hpp"
+#include "../ringbuffer.hpp"
+#include "../scheduler.hpp"
+#include "../sysex.hpp"
+
+struct DeviceInfo;
+
 struct JackData {
     static const size_t kBufSize = 128;
+    static const size_t kCacheLineSize = Arena::kAlignment;
+    static const unsigned kMaxProfiles = 16;
 
     enum Device {
         kNull,
@@ -33,19 +53,210 @@ struct JackData {
         kGenericJoystick,
     };
 
+    // generic joystick state, sized at init from JSIOCGAXES/JSIOCGBUTTONS, arrays are in arena
+    struct Joystick {
+        // written by the reader thread, protected by mutex
+        int16_t* axes;
+        uint32_t* buttons;
+        uint32_t* dirty;    // one bit per axis, then one bit per button
+        uint16_t* changes;  // dirty indices, in order of arrival
+        unsigned nchanges;
+
+        // owned by the process callback
+        alignas(kCacheLineSize) unsigned npending;
+        uint16_t* pending;
+        int16_t* pendingValues;
+        unsigned char* oldaxes;
+        uint32_t* oldbuttons;
+
+        Joystick() noexcept;
+    };
+
+    // user options, set before init
+    struct Options {
+        bool cv; // extra audio ports with a control-voltage signal per axis
+        bool readerdecode; // decode reports in the reader thread, see MidiQueue
+        unsigned short oscport; // send OSC to this local UDP port, 0 for none
+        unsigned oscinterval;   // milliseconds between OSC bundles, 0 for one per report
+        unsigned debounce; // button hold time in milliseconds, 0 for none, see Debounce
+        bool debouncedeferred;
+        unsigned char drumthreshold; // analog triggers as drum pads, 0 for none, see detectOnsets
+        unsigned char drumrelease;
+        bool polar; // sticks also as radius and angle, see processSticks
+        unsigned char sectors; // with polar, notes for the stick direction in this many sectors, 0 for none
+        bool motion; // accelerometer and gyro as 14-bit CCs, see processMotion
+        bool touchpad; // touchpad contacts as MPE notes, see processTouches
+        unsigned char governorhigh; // DSP load percent at which CCs are thinned out, 0 for none, see Governor
+        unsigned char governorlow;  // and below which they are restored
+        char recorder[256]; // directory for flight recorder dumps, empty for none, see Recorder
+        unsigned char split; // control groups with their own MIDI port, see SplitGroup
+        unsigned char chordkey; // initial Guitar Hero key, 0 for C, see GuitarHero::Chord
+        unsigned char chordscale;
+        bool sysex; // send the whole state as a single SysEx message instead of CCs and notes, see SysExSnapshot
+
+        Options() noexcept;
+    };
+
+    // control-voltage output, one audio port per axis
+    struct CV {
+        static const unsigned kMaxPorts = 32;
+
+        // axis value at a point in time, sent from the reader thread to the process callback
+        struct Point {
+            jack_nframes_t time;
+            unsigned axis;
+            float value;
+        };
+
+        unsigned count;
+        jack_port_t* ports[kMaxPorts];
+        float values[kMaxPorts];                               // owned by the process callback
+        alignas(kCacheLineSize) unsigned char last[kMaxPorts]; // owned by the reader thread
+        RingBuffer<Point, 1024> points;
+
+        CV() noexcept;
+    };
+
+    // drum pads on the analog triggers, owned by the reader thread
+    struct Drums {
+        static const unsigned kMaxTriggers = 8;
+
+        unsigned char last[kMaxTriggers]; // value in the previous report
+        bool active[kMaxTriggers];        // note-on sent, waiting for the release threshold
+        jack_nframes_t lasttime;
+
+        Drums() noexcept;
+    };
+
+    // sticks as polar coordinates, owned by whichever thread decodes reports
+    struct Sticks {
+        static const unsigned kMaxSticks = 4;
+
+        unsigned char radius[kMaxSticks]; // last sent CC values, 0xFF before the first
+        unsigned char angle[kMaxSticks];
+        unsigned char sector[kMaxSticks]; // current sector, 0xFF for none
+
+        Sticks() noexcept;
+    };
+
+    // touchpad contacts as MPE voices, owned by the reader thread
+    struct Touches {
+        static const unsigned kMaxTouches = 2;
+
+        unsigned char contact[kMaxTouches]; // contact ID of each voice, 0xFF when free
+        unsigned char note[kMaxTouches];
+        uint16_t bend[kMaxTouches];         // last sent values
+        unsigned char timbre[kMaxTouches];
+        bool configured; // MPE zone was set up
+
+        Touches() noexcept;
+    };
+
+    // capture latency of the output ports, measured at runtime and given to jack by the latency callback
+    struct Latency {
+        static const unsigned kWindow = 256; // reports per measurement
+
+        // owned by the reader thread, except "published" which is protected by mutex
+        jack_nframes_t lastread;
+        jack_nframes_t published; // frame time at which the report in buf was read
+        std::atomic<jack_nframes_t> interval; // average frames between reports
+        jack_nframes_t lastinterval; // as last given to jack
+
+        // owned by the process callback
+        alignas(kCacheLineSize) jack_nframes_t windowmin;
+        jack_nframes_t windowmax;
+        unsigned windowcount;
+
+        // frames from a report being read to the start of the cycle that sends it, for the last complete window
+        std::atomic<jack_nframes_t> min, max;
+        std::atomic<bool> changed;
+
+        Latency() noexcept;
+    };
+
+    // set at init, only read afterwards
     bool joystick;
     Device device;
+    const DeviceInfo* info; // set at init, see devices/registry.hpp
+    int id; // device number, as used in client and port names
     int fd;
     unsigned nread, nbuttons, naxes;
     pthread_t thread;
-    pthread_mutex_t mutex;
     jack_client_t* client;
     jack_port_t* midiport;
+    jack_port_t* midiports[MidiWriter::kMaxPorts]; // midiport first, then one per split control group
+    unsigned nmidiports;
+    jack_port_t* controlport;
+    unsigned char reportmask[kBufSize];
+    Options options;
+
+    // mapping profiles, loaded at init
+    MidiProfile profiles[kMaxProfiles];
+    unsigned nprofiles;
+
+    // device state sized at init, allocated once from arena, see each device's init
+    Arena arena;
+    void* state; // private to the device, see GuitarHero::State
+    Joystick js;
+
+    // the latest report, written by the reader thread with the lock held and copied out by the process callback
+    alignas(kCacheLineSize) pthread_mutex_t mutex;
+    std::atomic<unsigned> generation; // incremented by the reader each time buf changes, 0 means nothing was received yet
     unsigned char buf[kBufSize];
-    unsigned char oldbuf[kBufSize];
+
+    // owned by the reader thread
+    alignas(kCacheLineSize) unsigned nreports; // reports read so far
+    Debounce debounce;
+    Drums drums;
+    Motion motion;
+    Touches touches;
+
+    // owned by the process callback, or by the reader thread when options.readerdecode is set
+    alignas(kCacheLineSize) unsigned char oldbuf[kBufSize]; // the previous report, as last decoded
+    unsigned lastgeneration;
+    Sticks sticks;
+    MidiWriter midi;
+
+    // MIDI events for later frames, only used by the process thread
+    Scheduler scheduler;
+
+    // owned by the process callback, when options.sysex is set
+    SysExSnapshot snapshot;
+
+    // shared between threads, each with its own synchronization
+    alignas(kCacheLineSize) std::atomic<const MidiProfile*> profile; // the process callback switches to it at the start of each cycle
+    CV cv;
+    Latency latency;
+
+    // MIDI events decoded by the reader thread, when options.readerdecode is set
+    MidiQueue queue;
+
+    // fed by the reader thread, when options.oscport is set
+    OscOutput osc;
+
+    // when options.governorhigh is set
+    Governor governor;
+
+    // when options.recorder is set, reports are added by the reader and MIDI by the process callback
+    Recorder recorder;
+
+    // instances are over-aligned, plain new only guarantees alignof(max_align_t) before C++17
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr) noexcept;
 
     JackData() noexcept;
     ~JackData();
 };
 
+// Only the bytes used by the device process() are compared, so that counters and noisy sensors are ignored
+template <size_t N>
+static inline
+void setReportMask(JackData* const jackdata, const unsigned char (&list)[N][2])
+{
+    std::memset(jackdata->reportmask, 0, JackData::kBufSize);
+
+    for (size_t i=0; i<N; ++i)
+        jackdata->reportmask[list[i][0]] = list[i][1];
+}
+
 #endif // NOOICE_COMMON_HPP_INCLUDED
@@ -16,97 +16,307 @@
 
 #include "common.hpp"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/ioctl.h>
+#include <linux/joystick.h>
+
 namespace GenericJoystick {
 
 // --------------------------------------------------------------------------------------------------------------------
 
+// the js API numbers axes and buttons with 8 bits
+static const unsigned kMaxAxes    = 256;
+static const unsigned kMaxButtons = 256;
+
+// how many axes and buttons fit in a single MIDI channel before moving on to the next one
+static const unsigned kAxesPerChannel      = 16;  // CCs 1-16
+static const unsigned kButtonCCsPerChannel = 30;  // CCs 90-119
+
 static inline
-void process(JackData* const jackdata, void* const midibuf, unsigned char tmpbuf[JackData::kBufSize])
+unsigned getNumWords(const unsigned nbits) noexcept
 {
-    jack_midi_data_t mididata[3];
+    return (nbits + 31) / 32;
+}
+
+static inline
+bool getBit(const uint32_t* const bits, const unsigned i) noexcept
+{
+    return bits[i / 32] & (1u << (i % 32));
+}
+
+static inline
+void setBit(uint32_t* const bits, const unsigned i, const bool value) noexcept
+{
+    if (value)
+        bits[i / 32] |= 1u << (i % 32);
+    else
+        bits[i / 32] &= ~(1u << (i % 32));
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// allocate state for jackdata->naxes and jackdata->nbuttons from jackdata->arena, called once during init
+// Arrays written by the reader thread and the ones owned by the process callback each start on a cache line.
+
+static inline
+bool init(JackData* const jackdata)
+{
+    JackData::Joystick& js(jackdata->js);
+    Arena& arena(jackdata->arena);
+    const unsigned nitems = jackdata->naxes + jackdata->nbuttons;
+    const unsigned nbuttonwords = getNumWords(jackdata->nbuttons) + 1;
+
+    const size_t size = Arena::getSize<int16_t>(jackdata->naxes + 1)
+                      + Arena::getSize<uint32_t>(nbuttonwords)
+                      + Arena::getSize<uint32_t>(getNumWords(nitems) + 1)
+                      + Arena::getSize<uint16_t>(nitems + 1)
+                      + Arena::getSize<uint16_t>(nitems + 1)
+                      + Arena::getSize<int16_t>(nitems + 1)
+                      + Arena::getSize<unsigned char>(jackdata->naxes + 1)
+                      + Arena::getSize<uint32_t>(nbuttonwords);
+
+    if (! arena.reserve(size))
+        return false;
+
+    js.axes          = arena.allocate<int16_t>(jackdata->naxes + 1);
+    js.buttons       = arena.allocate<uint32_t>(nbuttonwords);
+    js.dirty         = arena.allocate<uint32_t>(getNumWords(nitems) + 1);
+    js.changes       = arena.allocate<uint16_t>(nitems + 1);
+    js.pending       = arena.allocate<uint16_t>(nitems + 1);
+    js.pendingValues = arena.allocate<int16_t>(nitems + 1);
+    js.oldaxes       = arena.allocate<unsigned char>(jackdata->naxes + 1);
+    js.oldbuttons    = arena.allocate<uint32_t>(nbuttonwords);
+
+    // invalid 7-bit values, so that all axes are sent once the initial state arrives
+    std::memset(js.oldaxes, 0xff, jackdata->naxes + 1);
+    return true;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// store a new event, called from the reader thread with the lock held
 
-    // first time, send everything
-    if (jackdata->oldbuf[jackdata->nread] == 0)
+static inline
+void push(JackData* const jackdata, const js_event& ev)
+{
+    JackData::Joystick& js(jackdata->js);
+    unsigned index;
+
+    switch (ev.type & ~JS_EVENT_INIT)
     {
-        // send CCs
-        mididata[0] = 0xB0;
+    case JS_EVENT_BUTTON:
+        if (ev.number >= jackdata->nbuttons)
+            return;
+        setBit(js.buttons, ev.number, ev.value != 0);
+        index = jackdata->naxes + ev.number;
+        break;
+    case JS_EVENT_AXIS:
+        if (ev.number >= jackdata->naxes)
+            return;
+        js.axes[ev.number] = ev.value;
+        index = ev.number;
+        break;
+    default:
+        return;
+    }
 
-        unsigned i=0;
-        for (; i<jackdata->naxes; ++i)
-        {
-            mididata[1] = i+1;
-            mididata[2] = jackdata->oldbuf[i] = tmpbuf[i]/2;
-            jack_midi_event_write(midibuf, 0, mididata, 3);
-        }
+    // already queued, the process callback will pick up the latest value
+    if (getBit(js.dirty, index))
+        return;
+
+    setBit(js.dirty, index, true);
+    js.changes[js.nchanges++] = index;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// take the queued changes, called from the process callback with the lock held
+
+static inline
+void fetch(JackData* const jackdata)
+{
+    JackData::Joystick& js(jackdata->js);
 
-        // save current button state
-        for (; i<jackdata->nread; ++i)
-            jackdata->oldbuf[i] = tmpbuf[i];
+    for (unsigned i=0, index; i<js.nchanges; ++i)
+    {
+        index = js.changes[i];
+        setBit(js.dirty, index, false);
 
-        // flag as initialized
-        jackdata->oldbuf[i] = 1;
+        js.pending[js.npending] = index;
+        js.pendingValues[js.npending] = index < jackdata->naxes
+                                      ? js.axes[index]
+                                      : getBit(js.buttons, index - jackdata->naxes);
+        ++js.npending;
     }
-    // send changes
-    else
+
+    js.nchanges = 0;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+template <class Writer>
+static inline
+void process(JackData* const jackdata, Writer& midi, unsigned char[JackData::kBufSize])
+{
+    JackData::Joystick& js(jackdata->js);
+    jack_midi_data_t mididata[3];
+
+    // only look at what changed since last time
+    for (unsigned i=0, index, k; i<js.npending; ++i)
     {
-        // send CCs
-        mididata[0] = 0xB0;
+        index = js.pending[i];
 
-        unsigned i=0;
-        for (; i < jackdata->naxes; ++i)
+        // CCs
+        if (index < jackdata->naxes)
         {
-            tmpbuf[i] /= 2;
-            if (tmpbuf[i] == jackdata->oldbuf[i])
+            const unsigned char value = (js.pendingValues[i] + 32768) >> 9;
+
+            if (value == js.oldaxes[index])
                 continue;
 
-            mididata[1] = i+1;
-            mididata[2] = jackdata->oldbuf[i] = tmpbuf[i];
-            jack_midi_event_write(midibuf, 0, mididata, 3);
+            js.oldaxes[index] = value;
+
+            mididata[0] = 0xB0 + index / kAxesPerChannel;
+            mididata[1] = 1 + index % kAxesPerChannel;
+            mididata[2] = value;
+            midi.write(0, mididata, 3, kSplitSticks);
+            continue;
         }
 
-        // send notes
-        unsigned char newbyte, oldbyte;
-        int mask, k;
+        // notes
+        k = index - jackdata->naxes;
 
-        for (; i<jackdata->nread; ++i)
-        {
-            if (tmpbuf[i] == jackdata->oldbuf[i])
-                continue;
+        const bool pressed = js.pendingValues[i] != 0;
 
-            // 8 byte masks
-            for (unsigned j=0; j<8; ++j)
-            {
-                mask    = 1<<j;
-                newbyte = tmpbuf[i] & mask;
-                oldbyte = jackdata->oldbuf[i] & mask;
-
-                if (newbyte == oldbyte)
-                    continue;
-
-                k = (i-jackdata->naxes)*8 + j;
-
-                // note
-                mididata[0] = newbyte ? 0x90 : 0x80;
-                mididata[1] = 60 + k;
-                mididata[2] = 100;
-                jack_midi_event_write(midibuf, 0, mididata, 3);
-
-                // 90+30 = 120, so avoid going over that
-                if (k < 30)
-                {
-                    // CC
-                    mididata[0] = 0xB0;
-                    mididata[1] = 90 + k;
-                    mididata[2] = newbyte ? 127 : 0;
-                    jack_midi_event_write(midibuf, 0, mididata, 3);
-                }
-            }
-
-            jackdata->oldbuf[i] = tmpbuf[i];
-        }
+        if (pressed == getBit(js.oldbuttons, k))
+            continue;
+
+        setBit(js.oldbuttons, k, pressed);
+
+        // note numbers continue on the next channel after 127
+        mididata[0] = (pressed ? 0x90 : 0x80) + (60 + k) / 128;
+        mididata[1] = (60 + k) % 128;
+        mididata[2] = 100;
+        midi.write(0, mididata, 3);
+
+        // CC
+        mididata[0] = 0xB0 + k / kButtonCCsPerChannel;
+        mididata[1] = 90 + k % kButtonCCsPerChannel;
+        mididata[2] = pressed ? 127 : 0;
+        midi.write(0, mididata, 3);
     }
+
+    js.npending = 0;
 }
 
+// --------------------------------------------------------------------------------------------------------------------
+// take the pending changes into jackdata->snapshot instead of sending them, for options.sysex
+
+static inline
+void setSnapshot(JackData* const jackdata) noexcept
+{
+    JackData::Joystick& js(jackdata->js);
+    SysExSnapshot& snapshot(jackdata->snapshot);
+
+    snapshot.naxes = jackdata->naxes;
+    snapshot.nbuttonbytes = (jackdata->nbuttons + 7) / 8;
+
+    for (unsigned i=0, index; i<js.npending; ++i)
+    {
+        index = js.pending[i];
+
+        if (index < jackdata->naxes)
+            snapshot.axes[index] = js.pendingValues[i] + 32768;
+        else
+            snapshot.setButton(index - jackdata->naxes, js.pendingValues[i] != 0);
+    }
+
+    js.npending = 0;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// compile-time description of the device, see registry.hpp
+// Matches any joystick, so it must be the last one in the list.
+
+struct Traits {
+    static const JackData::Device kDevice = JackData::kGenericJoystick;
+    static const bool kJoystick = true;
+    static const unsigned kReportSize = 0; // state is kept separately, not in buf
+    static const unsigned kNumButtonBytes = 0;
+    static const unsigned kNumButtonMasks = 0; // js button events are debounced directly
+    static constexpr const unsigned char (*kButtonMasks)[2] = nullptr;
+    static const unsigned kNumTriggers = 0;
+    static constexpr const unsigned char (*kTriggers)[2] = nullptr;
+    static const unsigned kNumSticks = 0;
+    static constexpr const unsigned char (*kSticks)[2] = nullptr;
+    static const unsigned kNumMotionSensors = 0;
+    static constexpr const unsigned char* kMotionSensors = nullptr;
+    static const unsigned kNumTouches = 0;
+    static constexpr const unsigned char* kTouches = nullptr;
+
+    static bool matches(const int, const int) noexcept
+    {
+        return true;
+    }
+
+    static bool init(JackData* const jackdata)
+    {
+        unsigned char n;
+
+        n = 0;
+        if (ioctl(jackdata->fd, JSIOCGAXES, &n) >= 0)
+            jackdata->naxes = std::min<unsigned>(n, kMaxAxes);
+
+        n = 0;
+        if (ioctl(jackdata->fd, JSIOCGBUTTONS, &n) >= 0)
+            jackdata->nbuttons = std::min<unsigned>(n, kMaxButtons);
+
+        printf("nooice::open(%i) - joystick has %u axes and %u buttons\n", jackdata->fd, jackdata->naxes, jackdata->nbuttons);
+
+        return GenericJoystick::init(jackdata);
+    }
+
+    static void setAlias(JackData* const jackdata)
+    {
+        char name[128];
+        if (ioctl(jackdata->fd, JSIOCGNAME(sizeof(name)), name) < 0)
+            strncpy(name, "Generic Joystick", sizeof(name));
+        jack_port_set_alias(jackdata->midiport, name);
+    }
+
+    static unsigned getNumAxes(const JackData* const jackdata) noexcept
+    {
+        return jackdata->naxes;
+    }
+
+    // axes and buttons are not in buf
+    static unsigned getAxisByte(const unsigned) noexcept
+    {
+        return 0;
+    }
+
+    static unsigned char getButtonByte(const unsigned char[JackData::kBufSize], const unsigned) noexcept
+    {
+        return 0;
+    }
+
+    static void setSnapshot(JackData* const jackdata, const unsigned char[JackData::kBufSize]) noexcept
+    {
+        GenericJoystick::setSnapshot(jackdata);
+    }
+
+    static void fetch(JackData* const jackdata)
+    {
+        GenericJoystick::fetch(jackdata);
+    }
+
+    template <class Writer>
+    static void process(JackData* const jackdata, Writer& midi, unsigned char tmpbuf[JackData::kBufSize])
+    {
+        GenericJoystick::process(jackdata, midi, tmpbuf);
+    }
+};
+
 // --------------------------------------------------------------------------------------------------------------------
 
 }
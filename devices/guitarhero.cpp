@@ -28,14 +28,6 @@ enum Bytes {
     kBytesX          = 6,
     kBytesTriggerY   = 7,
     kBytesButtons    = 8,
-    // special bytes, used for internal data
-    kBytesReservedInitiated  = 64,
-    kBytesReservedCurOctave  = 65,
-    kBytesReservedNoteGreen  = 66,
-    kBytesReservedNoteRed    = 67,
-    kBytesReservedNoteBlue   = 68,
-    kBytesReservedNoteYellow = 69,
-    kBytesReservedNoteOrange = 70,
 };
 
 // kBytesButtons
@@ -55,21 +47,144 @@ static const Bytes kListCCs[] = {
     kBytesGyro__2,
 };
 
+// bytes with 8 buttons each
+static const Bytes kListButtons[] = {
+    kBytesButtons,
+};
+
+// button bits of each byte, for debouncing
+static const unsigned char kListButtonMasks[][2] = {
+    { kBytesButtons, 0xFF },
+};
+
+// frames between the notes of a strummed chord
+static const jack_nframes_t kStrumDelay = 25;
+
+// --------------------------------------------------------------------------------------------------------------------
+// Chords, one for each combination of the 5 fret buttons, indexed by their bits in kBytesButtons
+// The first pressed fret on the neck picks the scale degree, the fret right after it adds the seventh,
+// and each of the others moves the chord one inversion up. A table is built for every key and scale at init,
+// so a strum is a single lookup and switching key or scale swaps the table.
+
+static const unsigned kFretMask = 0x1F;
+static const unsigned kNumFretCombinations = kFretMask + 1;
+static const unsigned kMaxChordNotes = 4;
+static const unsigned kNumKeys = 12;
+
+enum Scale {
+    kScaleMajor,
+    kScaleMinor,
+    kScaleDorian,
+    kScaleMixolydian,
+    kNumScales
+};
+
+static const char* const kScaleNames[kNumScales] = {
+    "major",
+    "minor",
+    "dorian",
+    "mixolydian",
+};
+
+// semitones of each scale degree above the key
+static const unsigned char kScaleSteps[kNumScales][7] = {
+    { 0, 2, 4, 5, 7, 9, 11 },
+    { 0, 2, 3, 5, 7, 8, 10 },
+    { 0, 2, 3, 5, 7, 9, 10 },
+    { 0, 2, 4, 5, 7, 9, 10 },
+};
+
+// frets in the order they sit on the neck, and the scale degree each one plays as the first pressed fret
+static const unsigned char kListFrets[][2] = {
+    { kButtonMaskGreen,  0 }, // I
+    { kButtonMaskRed,    3 }, // IV
+    { kButtonMaskYellow, 4 }, // V
+    { kButtonMaskBlue,   5 }, // vi
+    { kButtonMaskOrange, 1 }, // ii
+};
+
+// semitones above the octave, lowest first, key included
+struct Chord {
+    unsigned char count;
+    unsigned char notes[kMaxChordNotes];
+};
+
 static inline
-void process(JackData* const jackdata, void* const midibuf, unsigned char tmpbuf[JackData::kBufSize])
+void buildChord(Chord& chord, const unsigned frets, const unsigned key, const unsigned scale) noexcept
 {
+    static const unsigned kNumFrets = sizeof(kListFrets)/sizeof(kListFrets[0]);
+
+    chord.count = 0;
+
+    unsigned first = 0;
+    while (first < kNumFrets && (frets & kListFrets[first][0]) == 0)
+        ++first;
+
+    if (first == kNumFrets)
+        return;
+
+    const bool seventh = first + 1 < kNumFrets && (frets & kListFrets[first + 1][0]) != 0;
+    const unsigned count = seventh ? 4 : 3;
+
+    unsigned inversion = __builtin_popcount(frets) - (seventh ? 2 : 1);
+    if (inversion >= count)
+        inversion = count - 1;
+
+    // stacked thirds from the degree, the lowest notes of an inversion go up an octave
+    for (unsigned i=0, step; i<count; ++i)
+    {
+        step = kListFrets[first][1] + ((i + inversion) % count) * 2;
+        chord.notes[i] = key + kScaleSteps[scale][step % 7] + (step / 7) * 12 + (i + inversion >= count ? 12 : 0);
+    }
+
+    chord.count = count;
+}
+
+// private state in jackdata->state, allocated from jackdata->arena at init
+// Owned by whichever thread decodes reports.
+struct State {
+    bool initiated;
+    bool modified; // back or start were used while holding xbox
+    unsigned char octave;
+    unsigned char key;
+    unsigned char scale;
+    const Chord* tables; // kNumFretCombinations chords for each scale and key, in jackdata->arena
+    const Chord* chords; // the table for the current key and scale
+    uint32_t held[4];    // notes that are on, one bit per note number
+
+    void setTable(const unsigned newKey, const unsigned newScale) noexcept
+    {
+        key = newKey;
+        scale = newScale;
+        chords = tables + (scale * kNumKeys + key) * kNumFretCombinations;
+    }
+};
+
+static inline
+State& getState(JackData* const jackdata) noexcept
+{
+    return *static_cast<State*>(jackdata->state);
+}
+
+// bytes used by process(), changes to any other bytes are ignored
+static const unsigned char kReportMask[][2] = {
+    { kBytesModulation, 0xFF },
+    { kBytesGyro__2, 0xFF },
+    { kBytesTriggerY, 0xFF },
+    { kBytesButtons, 0xFF },
+};
+
+template <class Writer>
+static inline
+void process(JackData* const jackdata, Writer& midi, unsigned char tmpbuf[JackData::kBufSize])
+{
+    State& state(getState(jackdata));
     jack_midi_data_t mididata[3];
 
     // first time, send everything
-    if (jackdata->oldbuf[kBytesReservedInitiated] == 0)
+    if (! state.initiated)
     {
-        jackdata->oldbuf[kBytesReservedInitiated]  = 1;
-        jackdata->oldbuf[kBytesReservedCurOctave]  = 5;
-        jackdata->oldbuf[kBytesReservedNoteGreen]  = 255;
-        jackdata->oldbuf[kBytesReservedNoteRed]    = 255;
-        jackdata->oldbuf[kBytesReservedNoteBlue]   = 255;
-        jackdata->oldbuf[kBytesReservedNoteYellow] = 255;
-        jackdata->oldbuf[kBytesReservedNoteOrange] = 255;
+        state.initiated = true;
 
         // send CCs
         mididata[0] = 0xB0;
@@ -78,7 +193,7 @@ void process(JackData* const jackdata, void* const midibuf, unsigned char tmpbuf
             k = kListCCs[i];
             mididata[1] = i+1;
             mididata[2] = jackdata->oldbuf[k] = tmpbuf[k]/2;
-            jack_midi_event_write(midibuf, 0, mididata, 3);
+            midi.write(0, mididata, 3);
         }
 
         // save current button state
@@ -97,7 +212,7 @@ void process(JackData* const jackdata, void* const midibuf, unsigned char tmpbuf
 
         mididata[1] = i+1;
         mididata[2] = jackdata->oldbuf[k] = tmpbuf[k];
-        jack_midi_event_write(midibuf, 0, mididata, 3);
+        midi.write(0, mididata, 3);
     }
 
     // send note on/off
@@ -105,106 +220,35 @@ void process(JackData* const jackdata, void* const midibuf, unsigned char tmpbuf
     {
         jackdata->oldbuf[kBytesTriggerY] = tmpbuf[kBytesTriggerY];
 
-        // note on
-        if (tmpbuf[kBytesTriggerY] != 0x7F)
+        // note offs, for the previous strum
+        mididata[0] = 0x80;
+        mididata[2] = 0;
+        for (unsigned i=0; i<4; ++i)
         {
-            const bool green  = tmpbuf[kBytesButtons] & kButtonMaskGreen;  // 10
-            const bool red    = tmpbuf[kBytesButtons] & kButtonMaskRed;    // 1
-            const bool yellow = tmpbuf[kBytesButtons] & kButtonMaskYellow; // 7
-            const bool blue   = tmpbuf[kBytesButtons] & kButtonMaskBlue;   // 5
-            const bool orange = tmpbuf[kBytesButtons] & kButtonMaskOrange; // 2
-
-            jack_nframes_t time = 0;
-            const unsigned char root = jackdata->oldbuf[kBytesReservedCurOctave]*12;
-
-            if (green)
-            {
-                mididata[0] = 0x90;
-                mididata[1] = root+10;
-                mididata[2] = 100;
-                jack_midi_event_write(midibuf, time, mididata, 3);
-                time += 25;
-                jackdata->oldbuf[kBytesReservedNoteGreen] = mididata[1];
-            }
-            if (red)
-            {
-                mididata[0] = 0x90;
-                mididata[1] = root+1;
-                mididata[2] = 100;
-                jack_midi_event_write(midibuf, time, mididata, 3);
-                time += 25;
-                jackdata->oldbuf[kBytesReservedNoteRed] = mididata[1];
-            }
-            if (yellow)
+            for (uint32_t bits = state.held[i]; bits != 0; bits &= bits - 1)
             {
-                mididata[0] = 0x90;
-                mididata[1] = root+7;
-                mididata[2] = 100;
-                jack_midi_event_write(midibuf, time, mididata, 3);
-                time += 25;
-                jackdata->oldbuf[kBytesReservedNoteYellow] = mididata[1];
-            }
-            if (blue)
-            {
-                mididata[0] = 0x90;
-                mididata[1] = root+5;
-                mididata[2] = 100;
-                jack_midi_event_write(midibuf, time, mididata, 3);
-                time += 25;
-                jackdata->oldbuf[kBytesReservedNoteBlue] = mididata[1];
-            }
-            if (orange)
-            {
-                mididata[0] = 0x90;
-                mididata[1] = root+2;
-                mididata[2] = 100;
-                jack_midi_event_write(midibuf, time, mididata, 3);
-                time += 25;
-                jackdata->oldbuf[kBytesReservedNoteOrange] = mididata[1];
+                mididata[1] = i*32 + __builtin_ctz(bits);
+                // still waiting to be strummed, just cancel it
+                if (! midi.cancelNote(0x90, mididata[1]))
+                    midi.write(0, mididata, 3);
             }
+
+            state.held[i] = 0;
         }
-        else
-        // note offs
+
+        // note on, strummed over the following frames
+        if (tmpbuf[kBytesTriggerY] != 0x7F)
         {
-            if (jackdata->oldbuf[kBytesReservedNoteGreen] < 128)
-            {
-                mididata[0] = 0x80;
-                mididata[1] = jackdata->oldbuf[kBytesReservedNoteGreen];
-                mididata[2] = 0;
-                jack_midi_event_write(midibuf, 0, mididata, 3);
-                jackdata->oldbuf[kBytesReservedNoteGreen] = 255;
-            }
-            if (jackdata->oldbuf[kBytesReservedNoteRed] < 128)
-            {
-                mididata[0] = 0x80;
-                mididata[1] = jackdata->oldbuf[kBytesReservedNoteRed];
-                mididata[2] = 0;
-                jack_midi_event_write(midibuf, 0, mididata, 3);
-                jackdata->oldbuf[kBytesReservedNoteRed] = 255;
-            }
-            if (jackdata->oldbuf[kBytesReservedNoteYellow] < 128)
-            {
-                mididata[0] = 0x80;
-                mididata[1] = jackdata->oldbuf[kBytesReservedNoteYellow];
-                mididata[2] = 0;
-                jack_midi_event_write(midibuf, 0, mididata, 3);
-                jackdata->oldbuf[kBytesReservedNoteYellow] = 255;
-            }
-            if (jackdata->oldbuf[kBytesReservedNoteBlue] < 128)
-            {
-                mididata[0] = 0x80;
-                mididata[1] = jackdata->oldbuf[kBytesReservedNoteBlue];
-                mididata[2] = 0;
-                jack_midi_event_write(midibuf, 0, mididata, 3);
-                jackdata->oldbuf[kBytesReservedNoteBlue] = 255;
-            }
-            if (jackdata->oldbuf[kBytesReservedNoteOrange] < 128)
+            const Chord& chord(state.chords[tmpbuf[kBytesButtons] & kFretMask]);
+            const unsigned root = state.octave*12;
+
+            mididata[0] = 0x90;
+            mididata[2] = 100;
+            for (unsigned i=0; i<chord.count && root + chord.notes[i] < 128; ++i)
             {
-                mididata[0] = 0x80;
-                mididata[1] = jackdata->oldbuf[kBytesReservedNoteOrange];
-                mididata[2] = 0;
-                jack_midi_event_write(midibuf, 0, mididata, 3);
-                jackdata->oldbuf[kBytesReservedNoteOrange] = 255;
+                mididata[1] = root + chord.notes[i];
+                midi.writeLater(i * kStrumDelay, mididata, 3);
+                state.held[mididata[1] / 32] |= 1u << (mididata[1] % 32);
             }
         }
     }
@@ -226,22 +270,46 @@ void process(JackData* const jackdata, void* const midibuf, unsigned char tmpbuf
         if (newbyte == oldbyte)
             continue;
 
+        // xbox resets the octave when released, unless it was held to change the key or scale
+        if (mask == kButtonMaskXbox)
+        {
+            if (newbyte != 0)
+                state.modified = false;
+            else if (! state.modified)
+                state.octave = 5;
+            continue;
+        }
+
         // we only care about button presses here
         if (newbyte == 0)
             continue;
 
+        if (tmpbuf[kBytesButtons] & kButtonMaskXbox)
+        {
+            switch (mask)
+            {
+            case kButtonMaskBack:
+                state.setTable(state.key, (state.scale + 1) % kNumScales);
+                state.modified = true;
+                break;
+            case kButtonMaskStart:
+                // up a fifth, going around the circle of fifths
+                state.setTable((state.key + 7) % kNumKeys, state.scale);
+                state.modified = true;
+                break;
+            }
+            continue;
+        }
+
         switch (mask)
         {
         case kButtonMaskBack:
-            if (jackdata->oldbuf[kBytesReservedCurOctave] > 0)
-                jackdata->oldbuf[kBytesReservedCurOctave] -= 1;
+            if (state.octave > 0)
+                state.octave -= 1;
             break;
         case kButtonMaskStart:
-            if (jackdata->oldbuf[kBytesReservedCurOctave] < 10)
-                jackdata->oldbuf[kBytesReservedCurOctave] += 1;
-            break;
-        case kButtonMaskXbox:
-            jackdata->oldbuf[kBytesReservedCurOctave] = 5;
+            if (state.octave < 10)
+                state.octave += 1;
             break;
         }
     }
@@ -249,6 +317,92 @@ void process(JackData* const jackdata, void* const midibuf, unsigned char tmpbuf
     jackdata->oldbuf[kBytesButtons] = tmpbuf[kBytesButtons];
 }
 
+// --------------------------------------------------------------------------------------------------------------------
+// compile-time description of the device, see registry.hpp
+
+struct Traits {
+    static const JackData::Device kDevice = JackData::kGuitarHero;
+    static const bool kJoystick = true;
+    static const unsigned kReportSize = 9;
+    static const unsigned kNumButtonBytes = sizeof(kListButtons)/sizeof(kListButtons[0]);
+    static const unsigned kNumButtonMasks = sizeof(kListButtonMasks)/sizeof(kListButtonMasks[0]);
+    static constexpr const unsigned char (*kButtonMasks)[2] = kListButtonMasks;
+    static const unsigned kNumTriggers = 0;
+    static constexpr const unsigned char (*kTriggers)[2] = nullptr;
+    static const unsigned kNumSticks = 0;
+    static constexpr const unsigned char (*kSticks)[2] = nullptr;
+    static const unsigned kNumMotionSensors = 0;
+    static constexpr const unsigned char* kMotionSensors = nullptr;
+    static const unsigned kNumTouches = 0;
+    static constexpr const unsigned char* kTouches = nullptr;
+
+    static bool matches(const int vendorID, const int productID) noexcept
+    {
+        return vendorID == 1430 && productID == 4748;
+    }
+
+    static bool init(JackData* const jackdata)
+    {
+        setReportMask(jackdata, kReportMask);
+
+        static const unsigned kNumChords = kNumScales * kNumKeys * kNumFretCombinations;
+
+        Arena& arena(jackdata->arena);
+
+        if (! arena.reserve(Arena::getSize<State>(1) + Arena::getSize<Chord>(kNumChords)))
+            return false;
+
+        State* const state = arena.create<State>();
+        Chord* const tables = arena.allocate<Chord>(kNumChords);
+
+        for (unsigned scale=0; scale<kNumScales; ++scale)
+            for (unsigned key=0; key<kNumKeys; ++key)
+                for (unsigned frets=0; frets<kNumFretCombinations; ++frets)
+                    buildChord(tables[(scale * kNumKeys + key) * kNumFretCombinations + frets], frets, key, scale);
+
+        state->octave = 5;
+        state->tables = tables;
+        state->setTable(jackdata->options.chordkey, jackdata->options.chordscale);
+
+        jackdata->state = state;
+        return true;
+    }
+
+    static void setAlias(JackData* const jackdata)
+    {
+        jack_port_set_alias(jackdata->midiport, "Guitar Hero");
+    }
+
+    static unsigned getNumAxes(const JackData* const) noexcept
+    {
+        return sizeof(kListCCs)/sizeof(kListCCs[0]);
+    }
+
+    static unsigned getAxisByte(const unsigned axis) noexcept
+    {
+        return kListCCs[axis];
+    }
+
+    static unsigned char getButtonByte(const unsigned char buf[JackData::kBufSize], const unsigned index) noexcept
+    {
+        return buf[kListButtons[index]];
+    }
+
+    static void setSnapshot(JackData* const jackdata, const unsigned char buf[JackData::kBufSize]) noexcept
+    {
+        jackdata->snapshot.setReport<Traits>(jackdata, buf);
+    }
+
+    // with the lock held, for state that is not kept in buf
+    static void fetch(JackData* const) noexcept {}
+
+    template <class Writer>
+    static void process(JackData* const jackdata, Writer& midi, unsigned char tmpbuf[JackData::kBufSize])
+    {
+        GuitarHero::process(jackdata, midi, tmpbuf);
+    }
+};
+
 // --------------------------------------------------------------------------------------------------------------------
 
 }
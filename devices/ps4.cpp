@@ -29,6 +29,8 @@ enum Bytes {
     kBytesButtons2 = 6,
     kBytesL2 = 8,
     kBytesR2 = 9,
+    kBytesTouch1 = 35,
+    kBytesTouch2 = 39,
 };
 
 // kBytesButtons1 (0x00-0x0F)
@@ -73,10 +75,57 @@ static const Bytes kListCCs[] = {
     kBytesR2,
 };
 
+// bytes with 8 buttons each, the arrows in kBytesButtons1 need ArrowValueToMask first
+static const Bytes kListButtons[] = {
+    kBytesButtons1,
+    kBytesButtons2,
+};
+
+// button bits of each byte, for debouncing
+static const unsigned char kListButtonMasks[][2] = {
+    { kBytesButtons1, 0xF0 }, // the arrows are a value, not bits
+    { kBytesButtons2, 0xFF },
+};
+
+// X and Y bytes of each stick
+static const unsigned char kListSticks[][2] = {
+    { kBytesLX, kBytesLY },
+    { kBytesRX, kBytesRY },
+};
+
+// analog triggers and their note as drum pads, on the GM drums channel
+static const unsigned char kListTriggers[][2] = {
+    { kBytesL2, 36 }, // bass drum
+    { kBytesR2, 38 }, // snare
+};
+
+// touchpad contacts, each one is an ID byte with 0x80 set when not touching, then 12-bit X and Y in 3 bytes
+static const unsigned char kListTouches[] = {
+    kBytesTouch1,
+    kBytesTouch2,
+};
+
+// notes for the buttons in kBytesButtons1 and kBytesButtons2, 2 semitones apart
+static const unsigned char kNoteBaseButtons1 = 50;
+static const unsigned char kNoteBaseButtons2 = 62;
+
+// bytes used by process(), changes to any other bytes are ignored
+static const unsigned char kReportMask[][2] = {
+    { kBytesLX, 0xFF },
+    { kBytesLY, 0xFF },
+    { kBytesRX, 0xFF },
+    { kBytesRY, 0xFF },
+    { kBytesButtons1, 0xFF },
+    { kBytesButtons2, 0xFF },
+    { kBytesL2, 0xFF },
+    { kBytesR2, 0xFF },
+};
+
 static const int ArrowValueToMask[] = {1, 3, 2, 6, 4, 12, 8, 9, 0};
 
+template <class Writer>
 static inline
-void process(JackData* const jackdata, void* const midibuf, unsigned char tmpbuf[JackData::kBufSize])
+void process(JackData* const jackdata, Writer& midi, unsigned char tmpbuf[JackData::kBufSize])
 {
     jack_midi_data_t mididata[3];
 
@@ -90,7 +139,7 @@ void process(JackData* const jackdata, void* const midibuf, unsigned char tmpbuf
             k = kListCCs[i];
             mididata[1] = i+1;
             mididata[2] = jackdata->oldbuf[k] = tmpbuf[k]/2;
-            jack_midi_event_write(midibuf, 0, mididata, 3);
+            midi.write(0, mididata, 3, kSplitSticks);
         }
 
         // save current button state
@@ -111,7 +160,7 @@ void process(JackData* const jackdata, void* const midibuf, unsigned char tmpbuf
 
             mididata[1] = i+1;
             mididata[2] = jackdata->oldbuf[k] = tmpbuf[k];
-            jack_midi_event_write(midibuf, 0, mididata, 3);
+            midi.write(0, mididata, 3, kSplitSticks);
         }
 
         // send notes
@@ -133,9 +182,9 @@ void process(JackData* const jackdata, void* const midibuf, unsigned char tmpbuf
 
                 // note
                 mididata[0] = newbyte ? 0x90 : 0x80;
-                mididata[1] = 50 + (i+1)*2;
+                mididata[1] = kNoteBaseButtons1 + (i+1)*2;
                 mididata[2] = 100;
-                jack_midi_event_write(midibuf, 0, mididata, 3);
+                midi.write(0, mididata, 3);
             }
 
             jackdata->oldbuf[kBytesButtons1] = tmpbuf[kBytesButtons1];
@@ -154,9 +203,9 @@ void process(JackData* const jackdata, void* const midibuf, unsigned char tmpbuf
 
                 // note
                 mididata[0] = newbyte ? 0x90 : 0x80;
-                mididata[1] = 62 + (i+1)*2;
+                mididata[1] = kNoteBaseButtons2 + (i+1)*2;
                 mididata[2] = 100;
-                jack_midi_event_write(midibuf, 0, mididata, 3);
+                midi.write(0, mididata, 3);
             }
 
             jackdata->oldbuf[kBytesButtons2] = tmpbuf[kBytesButtons2];
@@ -164,6 +213,77 @@ void process(JackData* const jackdata, void* const midibuf, unsigned char tmpbuf
     }
 }
 
+// --------------------------------------------------------------------------------------------------------------------
+// compile-time description of the device, see registry.hpp
+
+struct Traits {
+    static const JackData::Device kDevice = JackData::kDualShock4;
+    static const bool kJoystick = false;
+    static const unsigned kReportSize = 64;
+    static const unsigned kNumButtonBytes = sizeof(kListButtons)/sizeof(kListButtons[0]);
+    static const unsigned kNumButtonMasks = sizeof(kListButtonMasks)/sizeof(kListButtonMasks[0]);
+    static constexpr const unsigned char (*kButtonMasks)[2] = kListButtonMasks;
+    static const unsigned kNumTriggers = sizeof(kListTriggers)/sizeof(kListTriggers[0]);
+    static constexpr const unsigned char (*kTriggers)[2] = kListTriggers;
+    static const unsigned kNumSticks = sizeof(kListSticks)/sizeof(kListSticks[0]);
+    static constexpr const unsigned char (*kSticks)[2] = kListSticks;
+    static const unsigned kNumMotionSensors = 0;
+    static constexpr const unsigned char* kMotionSensors = nullptr;
+    static const unsigned kNumTouches = sizeof(kListTouches)/sizeof(kListTouches[0]);
+    static constexpr const unsigned char* kTouches = kListTouches;
+
+    static bool matches(const int vendorID, const int productID) noexcept
+    {
+        return vendorID == 0x054c && (productID == 0x05c4 || productID == 0x09cc || productID == 0x0ba0);
+    }
+
+    static bool init(JackData* const jackdata)
+    {
+        setReportMask(jackdata, kReportMask);
+        return true;
+    }
+
+    static void setAlias(JackData* const jackdata)
+    {
+        jack_port_set_alias(jackdata->midiport, "PS4 DualShock");
+    }
+
+    static unsigned getNumAxes(const JackData* const) noexcept
+    {
+        return sizeof(kListCCs)/sizeof(kListCCs[0]);
+    }
+
+    static unsigned getAxisByte(const unsigned axis) noexcept
+    {
+        return kListCCs[axis];
+    }
+
+    // the arrows are a value in the low nibble, given as a mask like the other buttons
+    static unsigned char getButtonByte(const unsigned char buf[JackData::kBufSize], const unsigned index) noexcept
+    {
+        const unsigned char byte = buf[kListButtons[index]];
+
+        if (kListButtons[index] != kBytesButtons1)
+            return byte;
+
+        return (byte & 0xF0) | ((byte & 0x0F) <= kButtonNone ? ArrowValueToMask[byte & 0x0F] : 0);
+    }
+
+    static void setSnapshot(JackData* const jackdata, const unsigned char buf[JackData::kBufSize]) noexcept
+    {
+        jackdata->snapshot.setReport<Traits>(jackdata, buf);
+    }
+
+    // with the lock held, for state that is not kept in buf
+    static void fetch(JackData* const) noexcept {}
+
+    template <class Writer>
+    static void process(JackData* const jackdata, Writer& midi, unsigned char tmpbuf[JackData::kBufSize])
+    {
+        PS4::process(jackdata, midi, tmpbuf);
+    }
+};
+
 // --------------------------------------------------------------------------------------------------------------------
 
 }
@@ -0,0 +1,105 @@
+/*
+ * nooice - ...
+ * Copyright (C) 2016-2017 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef NOOICE_REGISTRY_HPP_INCLUDED
+#define NOOICE_REGISTRY_HPP_INCLUDED
+
+#include "genericjoystick.cpp"
+#include "guitarhero.cpp"
+#include "ps3.cpp"
+#include "ps4.cpp"
+
+// --------------------------------------------------------------------------------------------------------------------
+// Per-device table, for everything outside of the process callback
+
+struct DeviceInfo {
+    JackData::Device device;
+    unsigned reportSize;
+    unsigned numButtonBytes;
+    unsigned numButtonMasks;
+    const unsigned char (*buttonMasks)[2]; // report byte and its button bits
+    unsigned numTriggers;
+    const unsigned char (*triggers)[2]; // report byte and note of each analog trigger
+    unsigned numMotionSensors;
+    const unsigned char* motionSensors; // report byte of each accelerometer and gyro value, see Motion
+    unsigned numTouches;
+    const unsigned char* touches; // report byte of each touchpad contact, followed by its X and Y
+
+    bool (*init)(JackData*); // false if its state could not be allocated
+    void (*setAlias)(JackData*);
+    unsigned (*getNumAxes)(const JackData*);
+    unsigned (*getAxisByte)(unsigned);
+    unsigned char (*getButtonByte)(const unsigned char*, unsigned);
+
+    // decodes a report into jackdata->queue, for options.readerdecode
+    void (*decode)(JackData*, MidiQueue&, unsigned char*);
+
+    // process callback with the device process() inlined into it
+    JackProcessCallback process;
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// Device lookup by IDs or report size, unrolled at compile time
+
+template <class... DeviceTraits> struct DeviceList;
+
+// defined next to the process callback
+template <class Device>
+static const DeviceInfo* getDeviceInfo() noexcept;
+
+template <>
+struct DeviceList<> {
+    static const DeviceInfo* match(const bool, const int, const int) noexcept
+    {
+        return nullptr;
+    }
+
+    static const DeviceInfo* guess(const bool, const int) noexcept
+    {
+        return nullptr;
+    }
+};
+
+template <class Device, class... Others>
+struct DeviceList<Device, Others...> {
+    static const DeviceInfo* match(const bool joystick, const int vendorID, const int productID) noexcept
+    {
+        if (Device::kJoystick == joystick && Device::matches(vendorID, productID))
+            return getDeviceInfo<Device>();
+
+        return DeviceList<Others...>::match(joystick, vendorID, productID);
+    }
+
+    // for unknown IDs, by the size of the input report
+    static const DeviceInfo* guess(const bool joystick, const int reportSize) noexcept
+    {
+        if (Device::kJoystick == joystick && Device::kReportSize != 0 && static_cast<int>(Device::kReportSize) == reportSize)
+            return getDeviceInfo<Device>();
+
+        return DeviceList<Others...>::guess(joystick, reportSize);
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// Supported devices, each one described by the Traits struct in its namespace
+// The list is checked in order, the first device that matches is used.
+// To add a new device, write its Traits and add it here.
+
+typedef DeviceList<PS3::Traits, PS4::Traits, GuitarHero::Traits, GenericJoystick::Traits> Devices;
+
+// --------------------------------------------------------------------------------------------------------------------
+
+#endif // NOOICE_REGISTRY_HPP_INCLUDED
@@ -0,0 +1,187 @@
+/*
+ * nooice - ...
+ * Copyright (C) 2016-2017 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef NOOICE_GOVERNOR_HPP_INCLUDED
+#define NOOICE_GOVERNOR_HPP_INCLUDED
+
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+
+#include <pthread.h>
+
+#include <jack/jack.h>
+
+// --------------------------------------------------------------------------------------------------------------------
+// Quality governor, lowers the CC rate while the jack DSP load is high
+// A separate thread checks jack_cpu_load() and the xrun count a few times per second. Above the high threshold,
+// or after an xrun, it goes one level down, and back up once the load stayed below the low threshold for a while.
+// The process callback and the reader thread only read "level", notes are never affected.
+//
+// Level 1 sends CCs at most every 10ms and drops the LSBs of 14-bit CCs, level 2 every 40ms and also stops
+// the motion sensors, see MidiWriter::setThinning and processMotion.
+
+class Governor {
+public:
+    static const unsigned kNumLevels = 3;
+    static const unsigned kLevelNoMotion = 2;
+
+    std::atomic<unsigned> level;  // 0 for full quality
+    std::atomic<unsigned> xruns;  // incremented by the xrun callback
+    jack_nframes_t intervals[kNumLevels]; // frames between CC updates for each level, 0 for no limit
+
+    Governor() noexcept
+        : level(0),
+          xruns(0),
+          client(nullptr),
+          high(0.f),
+          low(0.f),
+          running(false),
+          thread(0)
+    {
+        for (unsigned i=0; i<kNumLevels; ++i)
+            intervals[i] = 0;
+
+        pthread_mutex_init(&mutex, nullptr);
+
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&cond, &attr);
+        pthread_condattr_destroy(&attr);
+    }
+
+    ~Governor()
+    {
+        stop();
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&mutex);
+    }
+
+    // thresholds in percent of DSP load
+    bool start(jack_client_t* const jackClient, const unsigned highLoad, const unsigned lowLoad)
+    {
+        const jack_nframes_t sampleRate = jack_get_sample_rate(jackClient);
+        intervals[1] = sampleRate / 100;
+        intervals[2] = sampleRate / 25;
+
+        client = jackClient;
+        high = highLoad;
+        low = lowLoad;
+        running = true;
+
+        if (pthread_create(&thread, nullptr, threadRun, this) != 0)
+        {
+            fprintf(stderr, "nooice:: failed to create governor thread\n");
+            client = nullptr;
+            running = false;
+            return false;
+        }
+
+        return true;
+    }
+
+    // must be called before the client is closed
+    void stop()
+    {
+        if (client == nullptr)
+            return;
+
+        pthread_mutex_lock(&mutex);
+        running = false;
+        pthread_cond_signal(&cond);
+        pthread_mutex_unlock(&mutex);
+
+        pthread_join(thread, nullptr);
+        client = nullptr;
+    }
+
+private:
+    static const unsigned kCheckMs    = 250;
+    static const unsigned kCalmChecks = 8; // below the low threshold for this many checks before going back up
+
+    jack_client_t* client;
+    float high, low;
+    bool running;
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    void run()
+    {
+        timespec next;
+        clock_gettime(CLOCK_MONOTONIC, &next);
+
+        unsigned lastxruns = xruns.load(std::memory_order_relaxed);
+        unsigned calm = 0;
+
+        pthread_mutex_lock(&mutex);
+
+        while (running)
+        {
+            next.tv_nsec += long(kCheckMs) * 1000000;
+            next.tv_sec  += next.tv_nsec / 1000000000;
+            next.tv_nsec %= 1000000000;
+
+            while (running && pthread_cond_timedwait(&cond, &mutex, &next) == 0) {}
+
+            if (! running)
+                break;
+
+            const float load = jack_cpu_load(client);
+            const unsigned newxruns = xruns.load(std::memory_order_relaxed);
+            const unsigned oldlevel = level.load(std::memory_order_relaxed);
+            unsigned newlevel = oldlevel;
+
+            if (newxruns != lastxruns || load > high)
+            {
+                calm = 0;
+                if (oldlevel + 1 < kNumLevels)
+                    newlevel = oldlevel + 1;
+            }
+            else if (load >= low || oldlevel == 0)
+            {
+                calm = 0;
+            }
+            else if (++calm >= kCalmChecks)
+            {
+                calm = 0;
+                newlevel = oldlevel - 1;
+            }
+
+            if (newlevel != oldlevel)
+            {
+                level.store(newlevel, std::memory_order_relaxed);
+                printf("nooice:: governor level %u, dsp load %.1f%%, %u xruns\n", newlevel, load, newxruns - lastxruns);
+            }
+
+            lastxruns = newxruns;
+        }
+
+        pthread_mutex_unlock(&mutex);
+    }
+
+    static void* threadRun(void* const arg)
+    {
+        static_cast<Governor*>(arg)->run();
+        return nullptr;
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+#endif // NOOICE_GOVERNOR_HPP_INCLUDED
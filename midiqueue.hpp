@@ -0,0 +1,101 @@
+/*
+ * nooice - ...
+ * Copyright (C) 2016-2017 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef NOOICE_MIDIQUEUE_HPP_INCLUDED
+#define NOOICE_MIDIQUEUE_HPP_INCLUDED
+
+#include <atomic>
+#include <cstring>
+
+#include <jack/midiport.h>
+
+#include "midiwriter.hpp"
+#include "ringbuffer.hpp"
+
+// --------------------------------------------------------------------------------------------------------------------
+// What the devices write to when decoding in the reader thread
+// Events are timestamped with the frame time of the report, the process callback sends them one period later.
+
+struct MidiQueue {
+    struct Event {
+        jack_nframes_t time;
+        jack_midi_data_t data[3];
+        unsigned char size; // 0 cancels pending note-ons for data[0] and data[1]
+        unsigned char group;
+    };
+
+    static const unsigned kSize = 1024;
+    static const unsigned kReserved = 64; // only for note-offs and cancels, so that no note is left hanging
+
+    RingBuffer<Event, kSize> events;
+    jack_nframes_t now; // frame time of the report being decoded
+
+    // events that did not fit, read by other threads
+    std::atomic<unsigned> lost;
+
+    MidiQueue() noexcept
+        : now(0),
+          lost(0) {}
+
+    bool write(const jack_nframes_t time, const jack_midi_data_t* const data, const size_t size,
+               const SplitGroup group = kSplitNone) noexcept
+    {
+        return writeLater(time, data, size, group);
+    }
+
+    bool writeLater(const jack_nframes_t delay, const jack_midi_data_t* const data, const size_t size,
+                    const SplitGroup group = kSplitNone) noexcept
+    {
+        if (size == 0 || size > 3)
+            return false;
+
+        Event ev;
+        ev.time = now + delay;
+        ev.size = size;
+        ev.group = group;
+        std::memcpy(ev.data, data, size);
+        return push(ev, size == 3 && MidiWriter::isNoteOff(ev.data));
+    }
+
+    // the result is not known here, so the caller always sends its note-off too
+    bool cancelNote(const jack_midi_data_t status, const jack_midi_data_t note) noexcept
+    {
+        Event ev;
+        ev.time = now;
+        ev.data[0] = status;
+        ev.data[1] = note;
+        ev.data[2] = 0;
+        ev.size = 0;
+        ev.group = kSplitNone;
+        push(ev, true);
+        return false;
+    }
+
+private:
+    bool push(const Event& ev, const bool release) noexcept
+    {
+        if ((release || events.count() < kSize - kReserved) && events.push(ev))
+            return true;
+
+        // only written by the reader thread
+        lost.store(lost.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return false;
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+#endif // NOOICE_MIDIQUEUE_HPP_INCLUDED
@@ -0,0 +1,411 @@
+/*
+ * nooice - ...
+ * Copyright (C) 2016-2017 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef NOOICE_MIDIWRITER_HPP_INCLUDED
+#define NOOICE_MIDIWRITER_HPP_INCLUDED
+
+#include <atomic>
+#include <cstring>
+#include <stdint.h>
+
+#include <jack/midiport.h>
+
+// --------------------------------------------------------------------------------------------------------------------
+// A mapping profile, applied to everything the devices send
+
+struct MidiProfile {
+    unsigned char channel;  // added to the device channel
+    signed char transpose;  // added to note numbers
+    unsigned char velocity; // replaces note-on velocity, 0 to keep the device one
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// Control groups that can have their own MIDI port (options.split), everything else stays on the main port
+// Events are tagged with their group by whatever writes them, the port is only chosen when they are sent.
+
+enum SplitGroup {
+    kSplitNone,   // buttons, drum notes and everything else
+    kSplitSticks, // stick and trigger axes as CCs, polar CCs and sector notes
+    kSplitMotion, // processMotion CCs
+    kSplitTouch,  // processTouches MPE zone
+};
+
+static const unsigned kNumSplitGroups = 3; // not counting kSplitNone
+
+// --------------------------------------------------------------------------------------------------------------------
+// Where the devices write their MIDI events to
+// Keeps track of sounding notes, so they can be released when the profile changes
+// Events that do not fit in the port buffer are kept in a backlog and sent at the start of the next cycle,
+// note-offs first, so that a full buffer never leaves notes hanging.
+// With thinning (see Governor), CCs only keep their latest value and are all sent together every interval.
+// Events can be split into several ports by their SplitGroup, main port is 0.
+
+struct MidiWriter {
+    static constexpr const unsigned kBacklogSize = 256;
+    static constexpr const unsigned kMaxPorts = 4;
+
+    struct Event {
+        jack_midi_data_t data[3];
+        unsigned char size; // 0 once sent
+        unsigned char port;
+    };
+
+    void* buffers[kMaxPorts];
+    const MidiProfile* profile;
+    uint32_t held[16*128/32];
+    unsigned char heldports[16*128];
+
+    // port of each SplitGroup, kSplitNone is always 0
+    unsigned char groupports[kNumSplitGroups + 1];
+    Event backlog[kBacklogSize];
+    unsigned nbacklog;
+
+    // CC thinning
+    jack_nframes_t ccinterval; // 0 when disabled
+    bool cclsb;                // send the LSBs of 14-bit CCs
+    jack_nframes_t cclast;     // time of the last flush
+    uint32_t ccpending[16*128/32];
+    unsigned char ccvalues[16*128];
+    unsigned char ccvalueports[16*128];
+
+    // events that could not be sent nor kept in the backlog, read by other threads
+    std::atomic<unsigned> lost;
+
+    MidiWriter() noexcept
+        : profile(nullptr),
+          nbacklog(0),
+          ccinterval(0),
+          cclsb(true),
+          cclast(0),
+          lost(0)
+    {
+        std::memset(buffers, 0, sizeof(buffers));
+        std::memset(held, 0, sizeof(held));
+        std::memset(heldports, 0, sizeof(heldports));
+        std::memset(groupports, 0, sizeof(groupports));
+        std::memset(ccpending, 0, sizeof(ccpending));
+        std::memset(ccvalues, 0, sizeof(ccvalues));
+        std::memset(ccvalueports, 0, sizeof(ccvalueports));
+    }
+
+    // use new cycle buffers, one per port, sending as much of the backlog as fits
+    void begin(void* const newBuffers[kMaxPorts]) noexcept
+    {
+        std::memcpy(buffers, newBuffers, sizeof(buffers));
+
+        if (nbacklog == 0)
+            return;
+
+        // note-offs first, then everything else in the original order
+        bool full = false;
+
+        for (int pass=0; pass<2 && ! full; ++pass)
+        {
+            for (unsigned i=0; i<nbacklog; ++i)
+            {
+                Event& ev(backlog[i]);
+
+                if (ev.size == 0 || isNoteOff(ev.data) != (pass == 0))
+                    continue;
+
+                if (! send(0, ev.data, ev.size, ev.port))
+                {
+                    full = true;
+                    break;
+                }
+
+                ev.size = 0;
+            }
+        }
+
+        unsigned count = 0;
+
+        for (unsigned i=0; i<nbacklog; ++i)
+        {
+            if (backlog[i].size != 0)
+                backlog[count++] = backlog[i];
+        }
+
+        nbacklog = count;
+    }
+
+    // to be called after begin(), held back CCs are sent once the interval is over, or when thinning is disabled
+    void setThinning(const jack_nframes_t interval, const bool lsb, const jack_nframes_t now) noexcept
+    {
+        ccinterval = interval;
+        cclsb = lsb;
+
+        if (interval != 0 && now - cclast < interval)
+            return;
+
+        cclast = now;
+
+        jack_midi_data_t mididata[3];
+
+        for (unsigned i=0; i<sizeof(ccpending)/sizeof(ccpending[0]); ++i)
+        {
+            for (uint32_t bits = ccpending[i]; bits != 0; bits &= bits - 1)
+            {
+                const unsigned index = i*32 + __builtin_ctz(bits);
+
+                mididata[0] = 0xB0 + index / 128;
+                mididata[1] = index % 128;
+                mididata[2] = ccvalues[index];
+                output(0, mididata, 3, ccvalueports[index]);
+            }
+
+            ccpending[i] = 0;
+        }
+    }
+
+    bool write(const jack_nframes_t time, const jack_midi_data_t* const data, const size_t size,
+               const SplitGroup group = kSplitNone) noexcept
+    {
+        const unsigned char port = groupports[group];
+
+        // system messages are not affected by profiles
+        if (profile == nullptr || size < 2 || data[0] >= 0xF0)
+            return thin(time, data, size, port);
+
+        jack_midi_data_t mididata[3];
+        std::memcpy(mididata, data, size < 3 ? size : 3);
+
+        mididata[0] = (data[0] & 0xF0) | ((data[0] + profile->channel) & 0x0F);
+
+        switch (data[0] & 0xF0)
+        {
+        case 0xA0: {
+            const int note = data[1] + profile->transpose;
+
+            if (note < 0 || note > 127)
+                return false;
+
+            mididata[1] = note;
+        }   break;
+        case 0x80:
+        case 0x90: {
+            const int note = data[1] + profile->transpose;
+
+            if (note < 0 || note > 127)
+                return false;
+
+            mididata[1] = note;
+
+            const unsigned index = (mididata[0] & 0x0F)*128 + note;
+            const uint32_t mask = 1u << (index % 32);
+
+            if ((data[0] & 0xF0) == 0x90 && size == 3 && data[2] != 0)
+            {
+                held[index / 32] |= mask;
+                heldports[index] = port;
+
+                if (profile->velocity != 0)
+                    mididata[2] = profile->velocity;
+            }
+            else
+            {
+                // already released by a profile change
+                if ((held[index / 32] & mask) == 0)
+                    return true;
+
+                held[index / 32] &= ~mask;
+            }
+        }   break;
+        }
+
+        return thin(time, mididata, size < 3 ? size : 3, port);
+    }
+
+    // note-off, note-on with velocity 0, all-sound-off and all-notes-off
+    static bool isNoteOff(const jack_midi_data_t* const data) noexcept
+    {
+        switch (data[0] & 0xF0)
+        {
+        case 0x80:
+            return true;
+        case 0x90:
+            return data[2] == 0;
+        case 0xB0:
+            return data[1] == 120 || data[1] == 123;
+        default:
+            return false;
+        }
+    }
+
+    // whether an event can be sent right away, for the ones that are too large to wait in the backlog
+    bool fits(const size_t size, const SplitGroup group = kSplitNone) const noexcept
+    {
+        return nbacklog == 0 && jack_midi_max_event_size(buffers[groupports[group]]) >= size;
+    }
+
+    // send note-off for all notes currently sounding, then use the new profile
+    void setProfile(const MidiProfile* const newProfile, const jack_nframes_t time) noexcept
+    {
+        jack_midi_data_t mididata[3];
+
+        for (unsigned i=0; i<sizeof(held)/sizeof(held[0]); ++i)
+        {
+            for (uint32_t bits = held[i]; bits != 0; bits &= bits - 1)
+            {
+                const unsigned index = i*32 + __builtin_ctz(bits);
+
+                mididata[0] = 0x80 + index / 128;
+                mididata[1] = index % 128;
+                mididata[2] = 0;
+                output(time, mididata, 3, heldports[index]);
+            }
+
+            held[i] = 0;
+        }
+
+        profile = newProfile;
+    }
+
+private:
+    // holds back CCs while thinning, except the channel mode messages
+    bool thin(const jack_nframes_t time, const jack_midi_data_t* const data, const size_t size,
+              const unsigned char port) noexcept
+    {
+        if (ccinterval == 0 || size != 3 || (data[0] & 0xF0) != 0xB0 || data[1] >= 120)
+            return output(time, data, size, port);
+
+        if (! cclsb && data[1] >= 32 && data[1] < 64)
+            return true;
+
+        const unsigned index = (data[0] & 0x0F)*128 + data[1];
+
+        ccpending[index / 32] |= 1u << (index % 32);
+        ccvalues[index] = data[2];
+        ccvalueports[index] = port;
+        return true;
+    }
+
+    bool send(const jack_nframes_t time, const jack_midi_data_t* const data, const size_t size,
+              const unsigned char port) noexcept
+    {
+        void* const buffer = buffers[port];
+
+        return jack_midi_max_event_size(buffer) >= size && jack_midi_event_write(buffer, time, data, size) == 0;
+    }
+
+    // anything already waiting goes first, to keep events in order
+    bool output(const jack_nframes_t time, const jack_midi_data_t* const data, const size_t size,
+                const unsigned char port) noexcept
+    {
+        if (nbacklog == 0 && send(time, data, size, port))
+            return true;
+
+        if (enqueue(data, size, port))
+            return true;
+
+        addLost();
+        return false;
+    }
+
+    // only written by the process thread
+    void addLost() noexcept
+    {
+        lost.store(lost.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    bool enqueue(const jack_midi_data_t* const data, const size_t size, const unsigned char port) noexcept
+    {
+        if (size > 3)
+            return false;
+
+        const jack_midi_data_t status = data[0];
+        const bool noteOff = isNoteOff(data);
+
+        // a waiting CC only needs its latest value
+        if ((status & 0xF0) == 0xB0 && ! noteOff)
+        {
+            for (unsigned i=0; i<nbacklog; ++i)
+            {
+                if (backlog[i].data[0] == status && backlog[i].data[1] == data[1] && backlog[i].port == port)
+                {
+                    backlog[i].data[2] = data[2];
+                    return true;
+                }
+            }
+        }
+
+        // note-offs are sent before anything else, so notes that did not start yet must not start after them
+        if (noteOff)
+        {
+            const bool allNotes = (status & 0xF0) == 0xB0;
+            unsigned count = 0;
+            bool cancelled = false;
+
+            for (int i=int(nbacklog)-1; i>=0; --i)
+            {
+                const Event& ev(backlog[i]);
+
+                if ((ev.data[0] & 0x0F) != (status & 0x0F) || (ev.data[0] & 0xF0) != 0x90 || ev.data[2] == 0)
+                    continue;
+                if (! allNotes && ev.data[1] != data[1])
+                    continue;
+
+                backlog[i].size = 0;
+                cancelled = true;
+
+                if (! allNotes)
+                    break;
+            }
+
+            if (cancelled)
+            {
+                for (unsigned i=0; i<nbacklog; ++i)
+                {
+                    if (backlog[i].size != 0)
+                        backlog[count++] = backlog[i];
+                }
+
+                nbacklog = count;
+
+                // the note never started, nothing to release
+                if (! allNotes)
+                    return true;
+            }
+        }
+
+        if (nbacklog == kBacklogSize)
+        {
+            if (! noteOff)
+                return false;
+
+            // make room by dropping the oldest event that is not a note-off
+            unsigned i = 0;
+            for (; i<nbacklog && isNoteOff(backlog[i].data); ++i) {}
+
+            if (i == nbacklog)
+                return false;
+
+            std::memmove(&backlog[i], &backlog[i+1], sizeof(Event)*(nbacklog-i-1));
+            --nbacklog;
+            addLost();
+        }
+
+        Event& ev(backlog[nbacklog++]);
+        std::memcpy(ev.data, data, size);
+        ev.size = size;
+        ev.port = port;
+        return true;
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+#endif // NOOICE_MIDIWRITER_HPP_INCLUDED
@@ -0,0 +1,137 @@
+/*
+ * nooice - ...
+ * Copyright (C) 2016-2017 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef NOOICE_MOTION_HPP_INCLUDED
+#define NOOICE_MOTION_HPP_INCLUDED
+
+#include <stdint.h>
+
+#include <jack/types.h>
+
+// --------------------------------------------------------------------------------------------------------------------
+// Accelerometer and gyro filtering, run by the reader thread on every report with its frame time
+// Raw values go through a fast low-pass for the sensor noise, and the accelerometer also through a slow one that
+// follows gravity. Tilt is the fast accelerometer value, shake how far it is from gravity, rotation the fast gyro
+// value relative to its slowly tracked rest value.
+// Filter state is 16.16 fixed-point, the coefficients depend on the time since the previous report so the
+// response is the same at any report rate.
+
+struct Motion {
+    enum Sensors {
+        kAccelX,
+        kAccelY,
+        kAccelZ,
+        kGyro,
+        kNumSensors
+    };
+
+    enum Outputs {
+        kTiltX,
+        kTiltY,
+        kShake,
+        kRotation,
+        kNumOutputs
+    };
+
+    static const int kCenter = 512; // raw value at rest, 10 bits
+    static const int kOneG   = 113; // accelerometer units per g, full tilt range
+    static const int kGyroRange = 256; // gyro units for the full rotation range
+
+    jack_nframes_t fasttau, slowtau; // time constants in frames, set at init
+    jack_nframes_t lasttime;
+    bool started;
+
+    // last sent 14-bit values, 0xFFFF before the first
+    uint16_t sent[kNumOutputs];
+
+    Motion() noexcept
+        : fasttau(1),
+          slowtau(1),
+          lasttime(0),
+          started(false)
+    {
+        for (unsigned i=0; i<kNumSensors; ++i)
+            fast[i] = slow[i] = 0;
+
+        for (unsigned i=0; i<kNumOutputs; ++i)
+            sent[i] = 0xFFFF;
+    }
+
+    void update(const int raw[kNumSensors], const jack_nframes_t time) noexcept
+    {
+        // start from rest at the first values, instead of slowly rising from 0
+        if (! started)
+        {
+            for (unsigned i=0; i<kNumSensors; ++i)
+                fast[i] = slow[i] = int32_t(raw[i]) << 16;
+
+            lasttime = time;
+            started = true;
+            return;
+        }
+
+        const jack_nframes_t delta = time - lasttime;
+        lasttime = time;
+
+        const int64_t fastcoef = getCoefficient(delta, fasttau);
+        const int64_t slowcoef = getCoefficient(delta, slowtau);
+
+        for (unsigned i=0; i<kNumSensors; ++i)
+        {
+            const int32_t value = int32_t(raw[i]) << 16;
+            fast[i] += static_cast<int32_t>((value - fast[i]) * fastcoef >> 16);
+            slow[i] += static_cast<int32_t>((value - slow[i]) * slowcoef >> 16);
+        }
+    }
+
+    // 14-bit values, tilt and rotation centered on 8192
+    void getOutputs(uint16_t outputs[kNumOutputs]) const noexcept
+    {
+        outputs[kTiltX] = scale(fast[kAccelX] - (kCenter << 16), kOneG, true);
+        outputs[kTiltY] = scale(fast[kAccelY] - (kCenter << 16), kOneG, true);
+
+        // up to 2g away from gravity, over all axes
+        int32_t shake = 0;
+        for (unsigned i=kAccelX; i<=kAccelZ; ++i)
+            shake += fast[i] > slow[i] ? fast[i] - slow[i] : slow[i] - fast[i];
+
+        outputs[kShake]    = scale(shake, kOneG*2, false);
+        outputs[kRotation] = scale(fast[kGyro] - slow[kGyro], kGyroRange, true);
+    }
+
+private:
+    int32_t fast[kNumSensors]; // 16.16
+    int32_t slow[kNumSensors];
+
+    // 16.16 one-pole low-pass coefficient, delta / (delta + tau)
+    static int64_t getCoefficient(const jack_nframes_t delta, const jack_nframes_t tau) noexcept
+    {
+        return (int64_t(delta) << 16) / (int64_t(delta) + tau);
+    }
+
+    // 16.16 value within +/- range (or 0 to range when not bipolar) to 14 bits
+    static uint16_t scale(const int32_t value, const int range, const bool bipolar) noexcept
+    {
+        const int64_t scaled = bipolar ? 8192 + int64_t(value) * 8192 / (int64_t(range) << 16)
+                                       : int64_t(value) * 16384 / (int64_t(range) << 16);
+
+        return scaled < 0 ? 0 : scaled > 16383 ? 16383 : static_cast<uint16_t>(scaled);
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+#endif // NOOICE_MOTION_HPP_INCLUDED
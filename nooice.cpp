@@ -14,26 +14,28 @@
  * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <algorithm>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 
 #include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <linux/hidraw.h>
 #include <linux/joystick.h>
 
 #ifdef HAVE_UDEV
 #include <libudev.h>
-#include <sstream>
 #endif
 
 // --------------------------------------------------------------------------------------------------------------------
 
-#include "devices/genericjoystick.cpp"
-#include "devices/guitarhero.cpp"
-#include "devices/ps3.cpp"
-#include "devices/ps4.cpp"
+#include "devices/registry.hpp"
+
+#include "trace.hpp"
 
 // --------------------------------------------------------------------------------------------------------------------
 
@@ -49,21 +51,116 @@ static const int kJoystickMaxButton   = kJoystickButtonEnd-kJoystickButtonStart;
 JackData::JackData() noexcept
     : joystick(false),
       device(kNull),
+      info(nullptr),
+      id(0),
       fd(-1),
       nread(-1),
       nbuttons(0),
       naxes(0),
       thread(0),
       client(nullptr),
-      midiport(nullptr)
+      midiport(nullptr),
+      nmidiports(0),
+      controlport(nullptr),
+      nprofiles(0),
+      state(nullptr),
+      generation(0),
+      nreports(0),
+      lastgeneration(0),
+      profile(&profiles[0])
 {
     pthread_mutex_init(&mutex, nullptr);
+    std::memset(midiports, 0, sizeof(midiports));
+    std::memset(profiles, 0, sizeof(profiles));
+    std::memset(reportmask, 0xff, kBufSize);
     std::memset(buf, 0, kBufSize);
     std::memset(oldbuf, 0, kBufSize);
 }
 
+JackData::Options::Options() noexcept
+    : cv(false),
+      readerdecode(false),
+      oscport(0),
+      oscinterval(0),
+      debounce(0),
+      debouncedeferred(false),
+      drumthreshold(0),
+      drumrelease(0),
+      polar(false),
+      sectors(0),
+      motion(false),
+      touchpad(false),
+      governorhigh(0),
+      governorlow(0),
+      split(0),
+      chordkey(0),
+      chordscale(GuitarHero::kScaleMajor),
+      sysex(false)
+{
+    std::memset(recorder, 0, sizeof(recorder));
+}
+
+JackData::CV::CV() noexcept
+    : count(0)
+{
+    std::memset(ports, 0, sizeof(ports));
+    std::memset(values, 0, sizeof(values));
+    std::memset(last, 0, sizeof(last));
+}
+
+JackData::Drums::Drums() noexcept
+    : lasttime(0)
+{
+    std::memset(last, 0, sizeof(last));
+    std::memset(active, 0, sizeof(active));
+}
+
+JackData::Sticks::Sticks() noexcept
+{
+    std::memset(radius, 0xff, sizeof(radius));
+    std::memset(angle, 0xff, sizeof(angle));
+    std::memset(sector, 0xff, sizeof(sector));
+}
+
+JackData::Touches::Touches() noexcept
+    : configured(false)
+{
+    std::memset(contact, 0xff, sizeof(contact));
+    std::memset(note, 0, sizeof(note));
+    std::memset(bend, 0, sizeof(bend));
+    std::memset(timbre, 0, sizeof(timbre));
+}
+
+JackData::Latency::Latency() noexcept
+    : lastread(0),
+      published(0),
+      interval(0),
+      lastinterval(0),
+      windowmin(0),
+      windowmax(0),
+      windowcount(0),
+      min(0),
+      max(0),
+      changed(false) {}
+
+JackData::Joystick::Joystick() noexcept
+    : axes(nullptr),
+      buttons(nullptr),
+      dirty(nullptr),
+      changes(nullptr),
+      nchanges(0),
+      npending(0),
+      pending(nullptr),
+      pendingValues(nullptr),
+      oldaxes(nullptr),
+      oldbuttons(nullptr) {}
+
 JackData::~JackData()
 {
+    // uses the client
+    governor.stop();
+    recorder.stop();
+
     if (client != nullptr)
     {
         jack_deactivate(client);
@@ -76,117 +173,1369 @@ JackData::~JackData()
     pthread_mutex_destroy(&mutex);
 }
 
+void* JackData::operator new(const size_t size)
+{
+    void* ptr;
+    if (posix_memalign(&ptr, kCacheLineSize, size) != 0)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void JackData::operator delete(void* const ptr) noexcept
+{
+    std::free(ptr);
+}
+
 #ifdef HAVE_UDEV
 // --------------------------------------------------------------------------------------------------------------------
 // Use udev to look up the product and manufacturer IDs
+// The udev context is created once and shared by all clients in the process
+
+static struct udev* gUdev = nullptr;
+static pthread_mutex_t gUdevMutex = PTHREAD_MUTEX_INITIALIZER;
+
+__attribute__ ((destructor))
+static void releaseUdev()
+{
+    if (gUdev != nullptr)
+    {
+        udev_unref(gUdev);
+        gUdev = nullptr;
+    }
+}
 
 static bool getVendorProductID(const char* const sysname, int* const vendorID, int* const productID)
 {
-    struct udev* const udev = udev_new();
+    pthread_mutex_lock(&gUdevMutex);
 
-    if (udev == nullptr)
+    if (gUdev == nullptr)
+        gUdev = udev_new();
+
+    if (gUdev == nullptr)
     {
+        pthread_mutex_unlock(&gUdevMutex);
         fprintf(stderr, "nooice::open(\"%s\") - failed to use udev\n", sysname);
         return false;
     }
 
-    struct udev_device* dev = udev_device_new_from_subsystem_sysname(udev, "input", sysname);
-    dev = udev_device_get_parent_with_subsystem_devtype(dev, "usb", "usb_device");
+    bool ok = false;
+    struct udev_device* const dev = udev_device_new_from_subsystem_sysname(gUdev, "input", sysname);
+
+    // parent is owned by dev, must not be unref'd
+    struct udev_device* const usbdev = dev != nullptr
+                                     ? udev_device_get_parent_with_subsystem_devtype(dev, "usb", "usb_device")
+                                     : nullptr;
 
-    if (dev == nullptr)
+    if (usbdev == nullptr)
     {
         fprintf(stderr, "nooice::open(\"%s\") - failed to find parent USB device for VendorID/ProductID identification\n", sysname);
-        return false;
     }
+    else
+    {
+        const char* const vendor  = udev_device_get_sysattr_value(usbdev, "idVendor");
+        const char* const product = udev_device_get_sysattr_value(usbdev, "idProduct");
+
+        if (vendor != nullptr && product != nullptr)
+        {
+            *vendorID  = std::strtol(vendor, nullptr, 16);
+            *productID = std::strtol(product, nullptr, 16);
+            ok = true;
+        }
+    }
+
+    if (dev != nullptr)
+        udev_device_unref(dev);
+
+    pthread_mutex_unlock(&gUdevMutex);
+    return ok;
+}
+#endif
+
+// --------------------------------------------------------------------------------------------------------------------
+// Find the size of the largest input report from a HID report descriptor, including the report ID byte if used
+
+static int getInputReportSize(const unsigned char* const desc, const unsigned size)
+{
+    enum {
+        kItemMain   = 0,
+        kItemGlobal = 1,
+        kTagInput       = 0x8,
+        kTagReportSize  = 0x7,
+        kTagReportID    = 0x8,
+        kTagReportCount = 0x9,
+        kTagPush        = 0xA,
+        kTagPop         = 0xB,
+    };
+
+    static const unsigned kStackSize = 8;
+
+    unsigned bits[256];
+    std::memset(bits, 0, sizeof(bits));
+
+    unsigned reportSize[kStackSize], reportCount[kStackSize];
+    unsigned reportID = 0, level = 0;
+    bool usesReportIDs = false;
+
+    reportSize[0] = reportCount[0] = 0;
+
+    for (unsigned i=0; i<size;)
+    {
+        const unsigned char prefix = desc[i];
+
+        // long items carry no report information
+        if (prefix == 0xFE)
+        {
+            if (i+1 >= size)
+                break;
+            i += 3 + desc[i+1];
+            continue;
+        }
+
+        const unsigned len  = (prefix & 0x3) == 3 ? 4 : (prefix & 0x3);
+        const unsigned type = (prefix >> 2) & 0x3;
+        const unsigned tag  = prefix >> 4;
+
+        if (i+1+len > size)
+            break;
+
+        unsigned value = 0;
+        for (unsigned j=0; j<len; ++j)
+            value |= desc[i+1+j] << (8*j);
+
+        i += 1 + len;
+
+        if (type == kItemMain)
+        {
+            if (tag == kTagInput)
+                bits[reportID] += reportSize[level] * reportCount[level];
+        }
+        else if (type == kItemGlobal)
+        {
+            switch (tag)
+            {
+            case kTagReportSize:
+                reportSize[level] = value;
+                break;
+            case kTagReportID:
+                reportID = value & 0xFF;
+                usesReportIDs = true;
+                break;
+            case kTagReportCount:
+                reportCount[level] = value;
+                break;
+            case kTagPush:
+                if (level+1 < kStackSize)
+                {
+                    reportSize[level+1] = reportSize[level];
+                    reportCount[level+1] = reportCount[level];
+                    ++level;
+                }
+                break;
+            case kTagPop:
+                if (level > 0)
+                    --level;
+                break;
+            }
+        }
+    }
+
+    unsigned maxbits = 0;
+    for (unsigned i=0; i<256; ++i)
+        maxbits = std::max(maxbits, bits[i]);
+
+    if (maxbits == 0)
+        return 0;
+
+    return (maxbits + 7) / 8 + (usesReportIDs ? 1 : 0);
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Axes of the current device, for devices that keep their state in buf these are the CC bytes
+
+static inline
+unsigned getNumAxes(const JackData* const jackdata)
+{
+    return jackdata->info->getNumAxes(jackdata);
+}
+
+static inline
+unsigned getAxisByte(const JackData* const jackdata, const unsigned axis)
+{
+    return jackdata->info->getAxisByte(axis);
+}
+
+// raw devices only, generic joysticks have their own button state
+static inline
+unsigned getNumButtonBytes(const JackData* const jackdata)
+{
+    return jackdata->info->numButtonBytes;
+}
+
+static inline
+unsigned char getButtonByte(const JackData* const jackdata, const unsigned char buf[JackData::kBufSize],
+                            const unsigned index)
+{
+    return jackdata->info->getButtonByte(buf, index);
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Reports are compared with the mask set by the device, see setReportMask
+
+static inline
+bool isSameReport(const JackData* const jackdata, const unsigned char* const a, const unsigned char* const b) noexcept
+{
+    unsigned char diff = 0;
+
+    for (unsigned i=0; i<jackdata->nread; ++i)
+        diff |= (a[i] ^ b[i]) & jackdata->reportmask[i];
+
+    return diff == 0;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Control-voltage output
+// The reader timestamps each axis change, the process callback ramps between them one period later
+
+static void pushCV(JackData* const jackdata, const jack_nframes_t time, const unsigned axis, const float value)
+{
+    const JackData::CV::Point point = { time, axis, value };
+
+    // if full, drop it; the next change will catch up
+    jackdata->cv.points.push(point);
+}
+
+static void pushReportCV(JackData* const jackdata, const unsigned char buf[JackData::kBufSize], const jack_nframes_t time)
+{
+    JackData::CV& cv(jackdata->cv);
+
+    for (unsigned i=0; i<cv.count; ++i)
+    {
+        const unsigned char value = buf[getAxisByte(jackdata, i)];
+
+        if (value == cv.last[i])
+            continue;
+
+        cv.last[i] = value;
+        pushCV(jackdata, time, i, value / 255.f);
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// OSC output, see osc.hpp
+
+static void pushReportOsc(JackData* const jackdata, const unsigned char buf[JackData::kBufSize])
+{
+    OscOutput& osc(jackdata->osc);
+
+    osc.beginUpdate();
+
+    for (unsigned i=0, count=getNumAxes(jackdata); i<count; ++i)
+        osc.setAxis(i, buf[getAxisByte(jackdata, i)] / 255.f);
+
+    for (unsigned i=0, count=getNumButtonBytes(jackdata); i<count; ++i)
+    {
+        const unsigned char byte = getButtonByte(jackdata, buf, i);
+
+        for (unsigned j=0; j<8; ++j)
+            osc.setButton(i*8 + j, byte & (1 << j));
+    }
+
+    osc.endUpdate();
+}
+
+static void pushJoystickOsc(JackData* const jackdata, const js_event& ev)
+{
+    OscOutput& osc(jackdata->osc);
+
+    osc.beginUpdate();
+
+    if ((ev.type & ~JS_EVENT_INIT) == JS_EVENT_AXIS)
+        osc.setAxis(ev.number, ev.value / 32767.f);
+    else if ((ev.type & ~JS_EVENT_INIT) == JS_EVENT_BUTTON)
+        osc.setButton(ev.number, ev.value != 0);
+
+    osc.endUpdate();
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Drum pads on the analog triggers
+// This runs for every report, as the velocity comes from how fast the trigger rose since the previous one.
+// Notes are queued with the time the threshold was crossed and sent one period later, like options.readerdecode.
+
+static void detectOnsets(JackData* const jackdata, const unsigned char buf[JackData::kBufSize], const jack_nframes_t time)
+{
+    const DeviceInfo* const info = jackdata->info;
+    JackData::Drums& drums(jackdata->drums);
+
+    const unsigned threshold = jackdata->options.drumthreshold;
+    const unsigned release   = jackdata->options.drumrelease;
+    const unsigned count     = info->numTriggers < JackData::Drums::kMaxTriggers ? info->numTriggers
+                                                                               : JackData::Drums::kMaxTriggers;
+    const jack_nframes_t delta = time - drums.lasttime;
+    drums.lasttime = time;
+
+    // rising through the whole range within 5ms gives the maximum velocity
+    const jack_nframes_t fullrise = jack_get_sample_rate(jackdata->client) / 200;
+
+    jack_midi_data_t mididata[3];
+
+    for (unsigned i=0; i<count; ++i)
+    {
+        const unsigned value = buf[info->triggers[i][0]];
+        const unsigned last  = drums.last[i];
+        drums.last[i] = value;
+
+        // no slope to measure yet
+        if (jackdata->nreports == 1)
+            continue;
+
+        mididata[1] = info->triggers[i][1];
+
+        if (drums.active[i])
+        {
+            if (value > release)
+                continue;
+
+            drums.active[i] = false;
+
+            mididata[0] = 0x89;
+            mididata[2] = 0;
+            jackdata->queue.now = time;
+            jackdata->queue.write(0, mididata, 3);
+            continue;
+        }
+
+        if (last >= threshold || value < threshold)
+            continue;
+
+        drums.active[i] = true;
+
+        const unsigned rise = value - last;
+        const unsigned velocity = delta != 0 ? 127 * rise * fullrise / (255 * delta) : 127;
+
+        mididata[0] = 0x99;
+        mididata[2] = std::max(1u, std::min(127u, velocity));
+
+        // the threshold was crossed between the two reports, assuming a linear rise
+        jackdata->queue.now = time - delta + delta * (threshold - last) / rise;
+        jackdata->queue.write(0, mididata, 3);
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Accelerometer and gyro as 14-bit CCs, see Motion
+// This runs for every report, so that the filters see the sensors at full rate. Values are sent as MSB and LSB
+// CC pairs from kMotionCC, queued like detectOnsets, and only when they changed.
+
+static const unsigned char kMotionCC = 12; // tilt X, tilt Y, shake, rotation, LSBs 32 higher
+
+static void processMotion(JackData* const jackdata, const unsigned char buf[JackData::kBufSize], const jack_nframes_t time)
+{
+    const DeviceInfo* const info = jackdata->info;
+    Motion& motion(jackdata->motion);
+
+    int raw[Motion::kNumSensors];
+
+    for (unsigned i=0; i<Motion::kNumSensors; ++i)
+    {
+        const unsigned byte = info->motionSensors[i];
+        raw[i] = ((buf[byte] << 8) | buf[byte+1]) & 0x3FF;
+    }
+
+    motion.update(raw, time);
+
+    uint16_t outputs[Motion::kNumOutputs];
+    motion.getOutputs(outputs);
+
+    jack_midi_data_t mididata[3];
+    mididata[0] = 0xB0;
+    jackdata->queue.now = time;
+
+    for (unsigned i=0; i<Motion::kNumOutputs; ++i)
+    {
+        const uint16_t value = outputs[i];
+        const uint16_t old   = motion.sent[i];
+
+        if (value == old)
+            continue;
+
+        motion.sent[i] = value;
+
+        // the LSB alone is enough when the MSB did not change
+        if (old == 0xFFFF || (value >> 7) != (old >> 7))
+        {
+            mididata[1] = kMotionCC + i;
+            mididata[2] = value >> 7;
+            jackdata->queue.write(0, mididata, 3, kSplitMotion);
+        }
+
+        mididata[1] = kMotionCC + i + 32;
+        mididata[2] = value & 0x7F;
+        jackdata->queue.write(0, mididata, 3, kSplitMotion);
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Touchpad as an MPE surface, in the upper zone so it does not clash with the other channels
+// Each contact is a voice on its own member channel: the note comes from where it touched down, then X is sent
+// as pitch bend around it and Y as CC74. Contacts are followed by their ID, as they can change places in the report.
+// Events are queued like detectOnsets, a contact that did not move sends nothing.
+
+static const unsigned char kTouchChannel   = 15; // master channel, members are the ones below it
+static const unsigned char kTouchNote      = 48; // at the left edge
+static const unsigned      kTouchNotes     = 24; // across the touchpad
+static const unsigned      kTouchWidth     = 1920;
+static const unsigned      kTouchHeight    = 943;
+static const unsigned      kTouchBendRange = 48; // semitones, the MPE default
+
+static void processTouches(JackData* const jackdata, const unsigned char buf[JackData::kBufSize], const jack_nframes_t time)
+{
+    const DeviceInfo* const info = jackdata->info;
+    JackData::Touches& touches(jackdata->touches);
+    MidiQueue& queue(jackdata->queue);
+
+    const unsigned count = info->numTouches < JackData::Touches::kMaxTouches ? info->numTouches
+                                                                             : JackData::Touches::kMaxTouches;
+    jack_midi_data_t mididata[3];
+    queue.now = time;
+
+    // MPE configuration message, RPN 6 on the master channel
+    if (! touches.configured)
+    {
+        static const jack_midi_data_t kConfig[][2] = { { 101, 0 }, { 100, 6 }, { 6, JackData::Touches::kMaxTouches } };
+
+        touches.configured = true;
+        mididata[0] = 0xB0 | kTouchChannel;
+
+        for (unsigned i=0; i<3; ++i)
+        {
+            mididata[1] = kConfig[i][0];
+            mididata[2] = kConfig[i][1];
+            queue.write(0, mididata, 3, kSplitTouch);
+        }
+    }
+
+    unsigned char contacts[JackData::Touches::kMaxTouches];
+
+    for (unsigned i=0; i<count; ++i)
+    {
+        const unsigned char byte = buf[info->touches[i]];
+        contacts[i] = (byte & 0x80) ? 0xFF : byte;
+    }
+
+    // lifted contacts first, so their channel can be used again right away
+    for (unsigned v=0; v<JackData::Touches::kMaxTouches; ++v)
+    {
+        if (touches.contact[v] == 0xFF)
+            continue;
+
+        bool found = false;
+        for (unsigned i=0; i<count && ! found; ++i)
+            found = contacts[i] == touches.contact[v];
+
+        if (found)
+            continue;
+
+        touches.contact[v] = 0xFF;
+
+        mididata[0] = 0x80 | (kTouchChannel - 1 - v);
+        mididata[1] = touches.note[v];
+        mididata[2] = 0;
+        queue.write(0, mididata, 3, kSplitTouch);
+    }
+
+    for (unsigned i=0; i<count; ++i)
+    {
+        if (contacts[i] == 0xFF)
+            continue;
+
+        const unsigned char* const data = buf + info->touches[i];
+        const unsigned x = data[1] | (data[2] & 0x0F) << 8;
+        const unsigned y = data[2] >> 4 | data[3] << 4;
+
+        unsigned v = 0;
+        while (v < JackData::Touches::kMaxTouches && touches.contact[v] != contacts[i])
+            ++v;
+
+        const bool down = v == JackData::Touches::kMaxTouches;
+
+        if (down)
+        {
+            v = 0;
+            while (v < JackData::Touches::kMaxTouches && touches.contact[v] != 0xFF)
+                ++v;
+
+            // more contacts than voices
+            if (v == JackData::Touches::kMaxTouches)
+                continue;
+
+            const unsigned note = x < kTouchWidth ? x * kTouchNotes / kTouchWidth : kTouchNotes - 1;
+
+            touches.contact[v] = contacts[i];
+            touches.note[v] = kTouchNote + note;
+        }
+
+        // in semitones from the center of the note, times 256
+        const int offset = int(x * kTouchNotes * 256 / kTouchWidth) - int(touches.note[v] - kTouchNote) * 256 - 128;
+        const int bend = 8192 + offset * 8192 / int(kTouchBendRange * 256);
+        const uint16_t bend14 = bend < 0 ? 0 : bend > 16383 ? 16383 : bend;
+        const unsigned char timbre = y < kTouchHeight ? 127 - y * 127 / (kTouchHeight - 1) : 0;
+
+        const jack_midi_data_t channel = kTouchChannel - 1 - v;
+
+        // pitch bend and timbre go before the note-on, so it starts with them
+        if (down || bend14 != touches.bend[v])
+        {
+            mididata[0] = 0xE0 | channel;
+            mididata[1] = bend14 & 0x7F;
+            mididata[2] = bend14 >> 7;
+            queue.write(0, mididata, 3, kSplitTouch);
+            touches.bend[v] = bend14;
+        }
+
+        if (down || timbre != touches.timbre[v])
+        {
+            mididata[0] = 0xB0 | channel;
+            mididata[1] = 74;
+            mididata[2] = timbre;
+            queue.write(0, mididata, 3, kSplitTouch);
+            touches.timbre[v] = timbre;
+        }
+
+        if (down)
+        {
+            mididata[0] = 0x90 | channel;
+            mididata[1] = touches.note[v];
+            mididata[2] = 100;
+            queue.write(0, mididata, 3, kSplitTouch);
+        }
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// 4 samples at a time, using GCC vector extensions, plus a scalar tail
+typedef float float4 __attribute__ ((vector_size(16)));
+
+static inline
+void fillRamp(float* const out, const unsigned count, const float start, const float step) noexcept
+{
+    const float4 start4 = { start, start, start, start };
+    const float4 step4  = { step, step, step, step };
+    const float4 four   = { 4.f, 4.f, 4.f, 4.f };
+    float4 index4 = { 0.f, 1.f, 2.f, 3.f };
+    unsigned i = 0;
+
+    for (; i+4 <= count; i += 4, index4 += four)
+    {
+        const float4 value4 = start4 + step4 * index4;
+        std::memcpy(out + i, &value4, sizeof(float4));
+    }
+
+    for (; i<count; ++i)
+        out[i] = start + step * static_cast<float>(i);
+}
+
+static inline
+void fillValue(float* const out, const unsigned count, const float value) noexcept
+{
+    const float4 value4 = { value, value, value, value };
+    unsigned i = 0;
+
+    for (; i+4 <= count; i += 4)
+        std::memcpy(out + i, &value4, sizeof(float4));
+
+    for (; i<count; ++i)
+        out[i] = value;
+}
+
+static void processCV(JackData* const jackdata, const jack_nframes_t frames)
+{
+    JackData::CV& cv(jackdata->cv);
+
+    if (cv.count == 0)
+        return;
+
+    float* buffers[JackData::CV::kMaxPorts];
+    jack_nframes_t offsets[JackData::CV::kMaxPorts];
+
+    for (unsigned i=0; i<cv.count; ++i)
+    {
+        buffers[i] = (float*)jack_port_get_buffer(cv.ports[i], frames);
+        offsets[i] = 0;
+    }
+
+    const jack_nframes_t cycleStart = jack_last_frame_time(jackdata->client);
+
+    // points from the previous cycle are placed at the same offset within this one
+    for (const JackData::CV::Point* point; (point = cv.points.peek()) != nullptr; cv.points.pop())
+    {
+        const int32_t delta = static_cast<int32_t>(point->time + frames - cycleStart);
+
+        // arrived after this cycle started, leave it for the next one
+        if (delta >= static_cast<int32_t>(frames))
+            break;
+
+        const jack_nframes_t offset = delta > 0 ? delta : 0;
+        const unsigned i = point->axis;
+
+        if (offset > offsets[i])
+        {
+            const unsigned count = offset - offsets[i];
+            fillRamp(buffers[i] + offsets[i], count, cv.values[i], (point->value - cv.values[i]) / count);
+            offsets[i] = offset;
+        }
+
+        cv.values[i] = point->value;
+    }
+
+    // hold the last value until the end of the cycle
+    for (unsigned i=0; i<cv.count; ++i)
+        fillValue(buffers[i] + offsets[i], frames - offsets[i], cv.values[i]);
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Capture latency, from the time a report is read to its MIDI being sent at the start of a cycle.
+// The device state can also be up to one report interval older than the report itself.
+
+// reader side, for every report
+static void measureReportInterval(JackData* const jackdata, const jack_nframes_t time)
+{
+    JackData::Latency& latency(jackdata->latency);
+
+    if (jackdata->nreports > 1)
+    {
+        const jack_nframes_t delta = time - latency.lastread;
+        const jack_nframes_t average = latency.interval.load(std::memory_order_relaxed);
+
+        // pauses in the input do not count, only how often a control in use is reported
+        if (delta < jack_get_sample_rate(jackdata->client) / 10)
+            latency.interval.store(average == 0 ? delta : (average * 7 + delta) / 8, std::memory_order_relaxed);
+    }
+
+    latency.lastread = time;
+
+    const jack_nframes_t interval = latency.interval.load(std::memory_order_relaxed);
+    const jack_nframes_t tolerance = jack_get_buffer_size(jackdata->client) / 8;
+    const bool intervalChanged = interval > latency.lastinterval + tolerance || interval + tolerance < latency.lastinterval;
+
+    // let jack ask for the new values, not possible from the process callback
+    if (latency.changed.exchange(false, std::memory_order_acquire) || intervalChanged)
+    {
+        latency.lastinterval = interval;
+        jack_recompute_total_latencies(jackdata->client);
+    }
+}
+
+// process side, for every new report sent, with the lock held
+static void measureCycleDelay(JackData* const jackdata, const jack_nframes_t frames)
+{
+    JackData::Latency& latency(jackdata->latency);
+
+    const jack_nframes_t cycleStart = jack_last_frame_time(jackdata->client);
+    const jack_nframes_t delay = int32_t(cycleStart - latency.published) > 0 ? cycleStart - latency.published : 0;
+
+    if (latency.windowcount == 0 || delay < latency.windowmin)
+        latency.windowmin = delay;
+    if (latency.windowcount == 0 || delay > latency.windowmax)
+        latency.windowmax = delay;
+
+    if (++latency.windowcount < JackData::Latency::kWindow)
+        return;
+
+    latency.windowcount = 0;
+
+    // ignore small changes, hosts do not need to hear about every bit of jitter
+    const jack_nframes_t tolerance = frames / 8;
+    const jack_nframes_t min = latency.min.load(std::memory_order_relaxed);
+    const jack_nframes_t max = latency.max.load(std::memory_order_relaxed);
+
+    if (latency.windowmin + tolerance >= min && latency.windowmin <= min + tolerance &&
+        latency.windowmax + tolerance >= max && latency.windowmax <= max + tolerance)
+        return;
+
+    latency.min.store(latency.windowmin, std::memory_order_relaxed);
+    latency.max.store(latency.windowmax, std::memory_order_relaxed);
+    latency.changed.store(true, std::memory_order_release);
+}
+
+static void latency_callback(const jack_latency_callback_mode_t mode, void* const arg)
+{
+    JackData* const jackdata = (JackData*)arg;
+
+    if (mode != JackCaptureLatency)
+        return;
+
+    const jack_nframes_t interval = jackdata->latency.interval.load(std::memory_order_relaxed);
+
+    jack_latency_range_t range;
+
+    // CV points, and MIDI decoded by the reader, are always delayed by exactly one period
+    const jack_nframes_t period = jack_get_buffer_size(jackdata->client);
+
+    if (jackdata->options.readerdecode)
+    {
+        range.min = period;
+        range.max = period + interval;
+    }
+    else
+    {
+        range.min = jackdata->latency.min.load(std::memory_order_relaxed);
+        range.max = jackdata->latency.max.load(std::memory_order_relaxed) + interval;
+    }
+
+    for (unsigned i=0; i<jackdata->nmidiports; ++i)
+        jack_port_set_latency_range(jackdata->midiports[i], JackCaptureLatency, &range);
+
+    range.min = period;
+    range.max = period + interval;
+
+    for (unsigned i=0; i<jackdata->cv.count; ++i)
+        jack_port_set_latency_range(jackdata->cv.ports[i], JackCaptureLatency, &range);
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Sticks as XY pads, see Polar
+// X and Y are stretched to a square before the device sends them, radius and angle are sent as 2 CCs per stick
+// from kStickCC. With options.sectors, a note on channel 2 plays while the stick points into a sector.
+
+static const unsigned char kStickCC        = 20;
+static const unsigned char kStickNote      = 48; // first sector of the first stick, 16 notes per stick
+static const unsigned      kStickRadiusOn  = 80; // sector notes start above this radius, out of 128
+static const unsigned      kStickRadiusOff = 48; // and stop below this one
+
+static inline
+unsigned getSector(const unsigned angle, const unsigned nsectors)
+{
+    // the first sector is centered on up
+    const unsigned offset = (angle + Polar::kTurn*3/4 + Polar::kTurn/nsectors/2) % Polar::kTurn;
+    const unsigned sector = offset * nsectors / Polar::kTurn;
+
+    return sector < nsectors ? sector : nsectors - 1;
+}
+
+// keeps the current sector until the angle is an eighth of a sector past its boundaries
+static inline
+bool isInSector(const unsigned angle, const unsigned nsectors, const unsigned sector)
+{
+    const unsigned width = Polar::kTurn / nsectors;
+    const unsigned start = (Polar::kTurn/4 - width/2 + sector*width + Polar::kTurn - width/8) % Polar::kTurn;
+
+    return (angle + Polar::kTurn - start) % Polar::kTurn < width + width/4;
+}
+
+template <class Device, class Writer>
+static void processSticks(JackData* const jackdata, Writer& midi, unsigned char tmpbuf[JackData::kBufSize])
+{
+    JackData::Sticks& sticks(jackdata->sticks);
+    const unsigned nsectors = jackdata->options.sectors;
+
+    jack_midi_data_t mididata[3];
+    Polar::Position pos;
+
+    for (unsigned i=0; i<Device::kNumSticks && i<JackData::Sticks::kMaxSticks; ++i)
+    {
+        const unsigned char bx = Device::kSticks[i][0];
+        const unsigned char by = Device::kSticks[i][1];
+
+        // report Y goes down
+        gPolar.convert(tmpbuf[bx] - 128, 128 - tmpbuf[by], pos);
+
+        tmpbuf[bx] = pos.x + 128;
+        tmpbuf[by] = pos.y > -128 ? 128 - pos.y : 255;
+
+        const unsigned char radius = pos.radius < 127 ? pos.radius : 127;
+        const unsigned char angle  = pos.angle * 128 / Polar::kTurn;
+
+        mididata[0] = 0xB0;
+
+        if (radius != sticks.radius[i])
+        {
+            mididata[1] = kStickCC + i*2;
+            mididata[2] = sticks.radius[i] = radius;
+            midi.write(0, mididata, 3, kSplitSticks);
+        }
+
+        if (angle != sticks.angle[i])
+        {
+            mididata[1] = kStickCC + i*2 + 1;
+            mididata[2] = sticks.angle[i] = angle;
+            midi.write(0, mididata, 3, kSplitSticks);
+        }
+
+        if (nsectors == 0)
+            continue;
+
+        const unsigned char oldsector = sticks.sector[i];
+        unsigned char sector = oldsector;
+
+        if (oldsector == 0xFF)
+        {
+            if (pos.radius >= kStickRadiusOn)
+                sector = getSector(pos.angle, nsectors);
+        }
+        else if (pos.radius < kStickRadiusOff)
+        {
+            sector = 0xFF;
+        }
+        else if (! isInSector(pos.angle, nsectors, oldsector))
+        {
+            sector = getSector(pos.angle, nsectors);
+        }
+
+        if (sector == oldsector)
+            continue;
+
+        sticks.sector[i] = sector;
+
+        if (oldsector != 0xFF)
+        {
+            mididata[0] = 0x81;
+            mididata[1] = kStickNote + i*16 + oldsector;
+            mididata[2] = 0;
+            midi.write(0, mididata, 3, kSplitSticks);
+        }
+
+        if (sector != 0xFF)
+        {
+            mididata[0] = 0x91;
+            mididata[1] = kStickNote + i*16 + sector;
+            mididata[2] = 100;
+            midi.write(0, mididata, 3, kSplitSticks);
+        }
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Report decoding, either in the process callback or in the reader thread (options.readerdecode)
+
+// tmpbuf is modified by the device, then kept as the previous report
+template <class Device, class Writer>
+static void decodeReport(JackData* const jackdata, Writer& midi, unsigned char tmpbuf[JackData::kBufSize])
+{
+    if (jackdata->options.polar)
+        processSticks<Device>(jackdata, midi, tmpbuf);
+
+    Device::process(jackdata, midi, tmpbuf);
+
+    // cache current buf for comparison on next call
+    std::memcpy(jackdata->oldbuf, tmpbuf, jackdata->nread);
+}
+
+static_assert(Scheduler::kEvents > MidiQueue::kSize, "a full queue must fit in the scheduler");
+
+// process side of options.readerdecode, events keep their timing and are sent exactly one period later
+static void sendQueued(JackData* const jackdata, const jack_nframes_t frames)
+{
+    while (const MidiQueue::Event* const ev = jackdata->queue.events.peek())
+    {
+        if (ev->size == 0)
+            jackdata->scheduler.cancelNote(ev->data[0], ev->data[1]);
+        // no room in the scheduler, the rest waits for the next cycle so that nothing goes out of order
+        else if (! jackdata->scheduler.schedule(ev->time + frames, ev->data, ev->size, SplitGroup(ev->group)))
+            break;
+
+        jackdata->queue.events.pop();
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
+static int xrun_callback(void* const arg)
+{
+    JackData* const jackdata = (JackData*)arg;
+    jackdata->governor.xruns.fetch_add(1, std::memory_order_relaxed);
+
+    if (jackdata->recorder.isRunning())
+        jackdata->recorder.trigger(Recorder::kReasonXrun);
+
+    return 0;
+}
+
+static void shutdown_callback(void* const arg)
+{
+    JackData* const jackdata = (JackData*)arg;
+
+    jackdata->client = nullptr;
+}
+
+// start of every cycle, before any MIDI is written, returns the main MIDI port buffer
+static inline
+void* beginCycle(JackData* const jackdata, const jack_nframes_t frames)
+{
+    // get jack midi port buffers
+    void* midibufs[MidiWriter::kMaxPorts] = {};
+
+    for (unsigned i=0; i<jackdata->nmidiports; ++i)
+    {
+        midibufs[i] = jack_port_get_buffer(jackdata->midiports[i], frames);
+        jack_midi_clear_buffer(midibufs[i]);
+    }
+
+    jackdata->midi.begin(midibufs);
+    jackdata->scheduler.begin(jack_last_frame_time(jackdata->client));
+
+    // program changes on the control port select a profile
+    if (jackdata->controlport != nullptr)
+    {
+        void* const controlbuf = jack_port_get_buffer(jackdata->controlport, frames);
+        jack_midi_event_t ev;
+
+        for (uint32_t i=0, count=jack_midi_get_event_count(controlbuf); i<count; ++i)
+        {
+            if (jack_midi_event_get(&ev, controlbuf, i) != 0)
+                break;
+            if (ev.size != 2 || (ev.buffer[0] & 0xF0) != 0xC0 || ev.buffer[1] >= jackdata->nprofiles)
+                continue;
+
+            jackdata->profile.store(&jackdata->profiles[ev.buffer[1]], std::memory_order_release);
+        }
+    }
+
+    // profile changed, release notes from the old one
+    const MidiProfile* const profile = jackdata->profile.load(std::memory_order_acquire);
+
+    if (jackdata->midi.profile != profile)
+        jackdata->midi.setProfile(profile, 0);
+
+    // see Governor, held back CCs are sent first
+    if (jackdata->options.governorhigh != 0)
+    {
+        const unsigned level = jackdata->governor.level.load(std::memory_order_relaxed);
+        jackdata->midi.setThinning(jackdata->governor.intervals[level], level == 0,
+                                   jack_last_frame_time(jackdata->client));
+    }
+
+    // CV does not need the lock
+    processCV(jackdata, frames);
+
+    return midibufs[0];
+}
+
+// end of every cycle, after everything else was written
+static inline
+void endCycle(JackData* const jackdata, const jack_nframes_t frames)
+{
+    // scheduled events come after everything sent directly
+    jackdata->scheduler.run(jackdata->midi, frames);
+
+    if (! jackdata->recorder.isRunning())
+        return;
+
+    const jack_nframes_t start = jack_last_frame_time(jackdata->client);
+    jack_midi_event_t ev;
+
+    for (unsigned p=0; p<jackdata->nmidiports; ++p)
+    {
+        void* const midibuf = jackdata->midi.buffers[p];
+
+        for (uint32_t i=0, count=jack_midi_get_event_count(midibuf); i<count; ++i)
+        {
+            if (jack_midi_event_get(&ev, midibuf, i) != 0)
+                break;
+
+            jackdata->recorder.addMidi(start + ev.time, ev.buffer, ev.size);
+        }
+    }
+}
+
+// one instance per device, see getDeviceInfo()
+template <class Device>
+static int process_callback(const jack_nframes_t frames, void* const arg)
+{
+    JackData* const jackdata = (JackData*)arg;
+    NOOICE_RTCHECK_SCOPE();
+
+    // nothing new since the last cycle, no need to lock or decode anything
+    const unsigned generation = jackdata->generation.load(std::memory_order_acquire);
+    const bool changed = generation != jackdata->lastgeneration;
+
+    NOOICE_TRACE(cycle_start, jackdata->id, jack_last_frame_time(jackdata->client), generation);
+
+    // try lock asap, not fatal yet
+    bool locked = changed && pthread_mutex_trylock(&jackdata->mutex) == 0;
+
+    // stack data
+    unsigned char tmpbuf[JackData::kBufSize];
+
+    void* const midibuf = beginCycle(jackdata, frames);
+
+    // drum pad notes, see detectOnsets
+    sendQueued(jackdata, frames);
+
+    // a snapshot that did not fit before, otherwise it would only be sent again on the next change
+    if (! changed && jackdata->snapshot.pending)
+        jackdata->snapshot.write(jackdata->midi, 0, jackdata->id);
+
+    if (! changed)
+    {
+        endCycle(jackdata, frames);
+        NOOICE_TRACE(cycle_end, jackdata->id, jack_last_frame_time(jackdata->client), 0);
+        return 0;
+    }
+
+    // try lock again
+    if (! locked)
+    {
+        locked = pthread_mutex_trylock(&jackdata->mutex) == 0;
+
+        // could not try-lock until here, stop
+        if (! locked)
+        {
+            endCycle(jackdata, frames);
+            NOOICE_TRACE(cycle_end, jackdata->id, jack_last_frame_time(jackdata->client), 0);
+            return 0;
+        }
+    }
+
+    // the reader only changes this with the lock held
+    jackdata->lastgeneration = jackdata->generation.load(std::memory_order_relaxed);
+    measureCycleDelay(jackdata, frames);
+
+    // copy buf data into a temp location so we can release the lock
+    std::memcpy(tmpbuf, jackdata->buf, jackdata->nread);
+    Device::fetch(jackdata);
+
+    pthread_mutex_unlock(&jackdata->mutex);
+
+    if (jackdata->options.sysex)
+    {
+        Device::setSnapshot(jackdata, tmpbuf);
+        jackdata->snapshot.write(jackdata->midi, 0, jackdata->id);
+    }
+    else
+    {
+        CycleWriter writer(jackdata->midi, jackdata->scheduler);
+        decodeReport<Device>(jackdata, writer, tmpbuf);
+    }
+
+    endCycle(jackdata, frames);
+
+    NOOICE_TRACE(midi, jackdata->id, jackdata->lastgeneration, jack_midi_get_event_count(midibuf));
+    NOOICE_TRACE(cycle_end, jackdata->id, jack_last_frame_time(jackdata->client), 1);
+    return 0;
+}
+
+// options.readerdecode, reports were already decoded by the reader, only send them
+static int process_queued_callback(const jack_nframes_t frames, void* const arg)
+{
+    JackData* const jackdata = (JackData*)arg;
+    NOOICE_RTCHECK_SCOPE();
+
+    // every event of the reports decoded up to here is in the queue, and is sent in this cycle
+    const unsigned generation = jackdata->generation.load(std::memory_order_acquire);
+    const bool changed = generation != jackdata->lastgeneration;
+
+    NOOICE_TRACE(cycle_start, jackdata->id, jack_last_frame_time(jackdata->client), generation);
+
+    void* const midibuf = beginCycle(jackdata, frames);
+    sendQueued(jackdata, frames);
+    endCycle(jackdata, frames);
+
+    if (changed)
+    {
+        jackdata->lastgeneration = generation;
+        NOOICE_TRACE(midi, jackdata->id, generation, jack_midi_get_event_count(midibuf));
+    }
+
+    NOOICE_TRACE(cycle_end, jackdata->id, jack_last_frame_time(jackdata->client), changed);
+    return 0;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Device table, with everything for the device resolved at compile time
+
+template <class Device>
+static const DeviceInfo* getDeviceInfo() noexcept
+{
+    static const DeviceInfo info = {
+        Device::kDevice,
+        Device::kReportSize,
+        Device::kNumButtonBytes,
+        Device::kNumButtonMasks,
+        Device::kButtonMasks,
+        Device::kNumTriggers,
+        Device::kTriggers,
+        Device::kNumMotionSensors,
+        Device::kMotionSensors,
+        Device::kNumTouches,
+        Device::kTouches,
+        Device::init,
+        Device::setAlias,
+        Device::getNumAxes,
+        Device::getAxisByte,
+        Device::getButtonByte,
+        decodeReport<Device, MidiQueue>,
+        process_callback<Device>,
+    };
+
+    return &info;
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Names of the SplitGroup ports, from kSplitSticks on, options.split has one bit for each
+static const char* const kSplitGroupNames[kNumSplitGroups] = { "sticks", "motion", "touch" };
+
+// --------------------------------------------------------------------------------------------------------------------
+
+static bool nooice_parse_option(JackData* const jackdata, const char* const option)
+{
+    if (std::strcmp(option, "cv") == 0)
+    {
+        jackdata->options.cv = true;
+        return true;
+    }
+
+    if (std::strcmp(option, "readerdecode") == 0)
+    {
+        jackdata->options.readerdecode = true;
+        return true;
+    }
+
+    if (std::strcmp(option, "sysex") == 0)
+    {
+        jackdata->options.sysex = true;
+        return true;
+    }
+
+    // debounce=MS[:deferred]
+    if (std::strncmp(option, "debounce=", 9) == 0)
+    {
+        char mode[16] = "";
+        int hold = 0;
+        std::sscanf(option+9, "%d:%15s", &hold, mode);
+
+        if (hold < 1 || hold > 1000 || (mode[0] != '\0' && std::strcmp(mode, "deferred") != 0))
+        {
+            fprintf(stderr, "nooice:: invalid debounce option \"%s\"\n", option+9);
+            return false;
+        }
+
+        jackdata->options.debounce = hold;
+        jackdata->options.debouncedeferred = mode[0] != '\0';
+        return true;
+    }
+
+    // drums=THRESHOLD[:RELEASE]
+    if (std::strncmp(option, "drums=", 6) == 0)
+    {
+        int threshold = 0, release = -1;
+        std::sscanf(option+6, "%d:%d", &threshold, &release);
+
+        if (release < 0)
+            release = threshold / 2;
+
+        if (threshold < 1 || threshold > 255 || release >= threshold)
+        {
+            fprintf(stderr, "nooice:: invalid drums option \"%s\"\n", option+6);
+            return false;
+        }
+
+        jackdata->options.drumthreshold = threshold;
+        jackdata->options.drumrelease = release;
+        return true;
+    }
+
+    // polar[=SECTORS]
+    if (std::strcmp(option, "polar") == 0 || std::strncmp(option, "polar=", 6) == 0)
+    {
+        int sectors = 0;
+        std::sscanf(option+5, "=%d", &sectors);
+
+        if (sectors < 0 || sectors > 16)
+        {
+            fprintf(stderr, "nooice:: invalid polar option \"%s\", up to 16 sectors are supported\n", option+6);
+            return false;
+        }
+
+        jackdata->options.polar = true;
+        jackdata->options.sectors = sectors;
+        return true;
+    }
+
+    if (std::strcmp(option, "motion") == 0)
+    {
+        jackdata->options.motion = true;
+        return true;
+    }
+
+    if (std::strcmp(option, "touchpad") == 0)
+    {
+        jackdata->options.touchpad = true;
+        return true;
+    }
+
+    // governor[=HIGH[:LOW]]
+    if (std::strcmp(option, "governor") == 0 || std::strncmp(option, "governor=", 9) == 0)
+    {
+        int high = 75, low = -1;
+        std::sscanf(option+8, "=%d:%d", &high, &low);
+
+        if (low < 0)
+            low = high * 2 / 3;
+
+        if (high < 1 || high > 100 || low >= high)
+        {
+            fprintf(stderr, "nooice:: invalid governor option \"%s\"\n", option+9);
+            return false;
+        }
+
+        jackdata->options.governorhigh = high;
+        jackdata->options.governorlow = low;
+        return true;
+    }
+
+    // recorder[=DIR]
+    if (std::strcmp(option, "recorder") == 0 || std::strncmp(option, "recorder=", 9) == 0)
+    {
+        const char* const dir = option[8] == '=' ? option+9 : "/tmp";
+
+        if (dir[0] == '\0' || std::strlen(dir) >= sizeof(jackdata->options.recorder))
+        {
+            fprintf(stderr, "nooice:: invalid recorder option \"%s\"\n", option);
+            return false;
+        }
+
+        std::strcpy(jackdata->options.recorder, dir);
+        return true;
+    }
+
+    // chords=KEY[:SCALE]
+    if (std::strncmp(option, "chords=", 7) == 0)
+    {
+        static const char kKeyNames[] = "C D EF G A B";
+        const char* name = option+7;
+        const char* const letter = *name != '\0' && *name != ' ' ? std::strchr(kKeyNames, *name) : nullptr;
+
+        if (letter == nullptr)
+        {
+            fprintf(stderr, "nooice:: invalid chords option \"%s\", keys are C to B with an optional # or b\n", option+7);
+            return false;
+        }
+
+        int key = letter - kKeyNames;
+        ++name;
+
+        if (*name == '#')
+            ++key, ++name;
+        else if (*name == 'b')
+            --key, ++name;
+
+        unsigned scale = GuitarHero::kScaleMajor;
+
+        if (*name == ':')
+        {
+            for (scale=0; scale<GuitarHero::kNumScales; ++scale)
+            {
+                if (std::strcmp(name+1, GuitarHero::kScaleNames[scale]) == 0)
+                    break;
+            }
+        }
+        else if (*name != '\0')
+        {
+            scale = GuitarHero::kNumScales;
+        }
+
+        if (scale == GuitarHero::kNumScales)
+        {
+            fprintf(stderr, "nooice:: invalid chords option \"%s\", scales are major, minor, dorian and mixolydian\n", option+7);
+            return false;
+        }
 
-    {
-        std::stringstream ss;
-        ss << std::hex << udev_device_get_sysattr_value(dev, "idVendor");
-        *vendorID = std::strtol(ss.str().c_str(), nullptr, 16);
+        jackdata->options.chordkey = (key + 12) % 12;
+        jackdata->options.chordscale = scale;
+        return true;
     }
 
+    // split[=GROUP,...]
+    if (std::strcmp(option, "split") == 0 || std::strncmp(option, "split=", 6) == 0)
     {
-        std::stringstream ss;
-        ss << std::hex << udev_device_get_sysattr_value(dev, "idProduct");
-        *productID = std::strtol(ss.str().c_str(), nullptr, 16);
-    }
+        if (option[5] == '\0')
+        {
+            jackdata->options.split = (1u << kNumSplitGroups) - 1;
+            return true;
+        }
 
-    udev_device_unref(dev);
-    udev_unref(udev);
+        jackdata->options.split = 0;
 
-    return true;
-}
-#endif
+        for (const char* name = option+6; *name != '\0';)
+        {
+            const size_t len = std::strcspn(name, ",");
+            unsigned i = 0;
 
-// --------------------------------------------------------------------------------------------------------------------
+            while (i < kNumSplitGroups && (std::strlen(kSplitGroupNames[i]) != len ||
+                                           std::strncmp(name, kSplitGroupNames[i], len) != 0))
+                ++i;
 
-static void shutdown_callback(void* const arg)
-{
-    JackData* const jackdata = (JackData*)arg;
+            if (i == kNumSplitGroups)
+            {
+                fprintf(stderr, "nooice:: invalid split option \"%s\", groups are sticks, motion and touch\n", option+6);
+                return false;
+            }
 
-    jackdata->client = nullptr;
-}
+            jackdata->options.split |= 1u << i;
+            name += name[len] == ',' ? len + 1 : len;
+        }
 
-static int process_callback(const jack_nframes_t frames, void* const arg)
-{
-    JackData* const jackdata = (JackData*)arg;
+        return true;
+    }
 
-    // try lock asap, not fatal yet
-    bool locked = pthread_mutex_trylock(&jackdata->mutex) == 0;
+    // osc=PORT[:INTERVAL]
+    if (std::strncmp(option, "osc=", 4) == 0)
+    {
+        int port = 0, interval = 0;
+        std::sscanf(option+4, "%d:%d", &port, &interval);
 
-    // stack data
-    unsigned char tmpbuf[JackData::kBufSize];
+        if (port < 1 || port > 65535 || interval < 0)
+        {
+            fprintf(stderr, "nooice:: invalid osc option \"%s\"\n", option+4);
+            return false;
+        }
 
-    // get jack midi port buffer
-    void* const midibuf = jack_port_get_buffer(jackdata->midiport, frames);
-    jack_midi_clear_buffer(midibuf);
+        jackdata->options.oscport = port;
+        jackdata->options.oscinterval = interval;
+        return true;
+    }
 
-    // try lock again
-    if (! locked)
+    // profile=CHANNEL[:TRANSPOSE[:VELOCITY]], can be repeated
+    if (std::strncmp(option, "profile=", 8) == 0)
     {
-        locked = pthread_mutex_trylock(&jackdata->mutex) == 0;
+        if (jackdata->nprofiles == JackData::kMaxProfiles)
+        {
+            fprintf(stderr, "nooice:: too many profiles, up to %u are supported\n", JackData::kMaxProfiles);
+            return false;
+        }
 
-        // could not try-lock until here, stop
-        if (! locked)
-            return 0;
-    }
+        int channel = 1, transpose = 0, velocity = 0;
+        std::sscanf(option+8, "%d:%d:%d", &channel, &transpose, &velocity);
 
-    // copy buf data into a temp location so we can release the lock
-    std::memcpy(tmpbuf, jackdata->buf, jackdata->nread);
-    pthread_mutex_unlock(&jackdata->mutex);
+        if (channel < 1 || channel > 16 || transpose < -127 || transpose > 127 || velocity < 0 || velocity > 127)
+        {
+            fprintf(stderr, "nooice:: invalid profile \"%s\"\n", option+8);
+            return false;
+        }
 
-    switch (jackdata->device)
-    {
-    case JackData::kNull:
-        break;
-    case JackData::kDualShock3:
-        PS3::process(jackdata, midibuf, tmpbuf);
-        break;
-    case JackData::kDualShock4:
-        PS4::process(jackdata, midibuf, tmpbuf);
-        break;
-    case JackData::kGuitarHero:
-        GuitarHero::process(jackdata, midibuf, tmpbuf);
-        break;
-    case JackData::kGenericJoystick:
-        GenericJoystick::process(jackdata, midibuf, tmpbuf);
-        break;
+        MidiProfile& profile(jackdata->profiles[jackdata->nprofiles++]);
+        profile.channel   = channel - 1;
+        profile.transpose = transpose;
+        profile.velocity  = velocity;
+        return true;
     }
 
-    // cache current buf for comparison on next call
-    std::memcpy(jackdata->oldbuf, tmpbuf, jackdata->nread);
-    return 0;
+    fprintf(stderr, "nooice:: unknown option \"%s\"\n", option);
+    return false;
 }
 
-// --------------------------------------------------------------------------------------------------------------------
-
 static bool nooice_init(JackData* const jackdata, const char* const device)
 {
     if (device == nullptr || device[0] == '\0')
         return false;
 
-    int nread;
-    unsigned char buf[JackData::kBufSize];
+    // the reader queue only holds short messages
+    if (jackdata->options.sysex && jackdata->options.readerdecode)
+    {
+        fprintf(stderr, "nooice:: the sysex and readerdecode options cannot be used together\n");
+        return false;
+    }
 
     jackdata->joystick = strncmp(device, "/dev/input/js", 13) == 0;
 
@@ -198,78 +1547,93 @@ static bool nooice_init(JackData* const jackdata, const char* const device)
 
     int deviceNum = atoi(device+(strlen(device)-1));
 
-    if ((nread = read(jackdata->fd, buf, jackdata->joystick ? sizeof(js_event) : JackData::kBufSize)) < 0)
-    {
-        fprintf(stderr, "nooice::read(%i) - failed to read from device\n", jackdata->fd);
-        return false;
-    }
-
-    printf("nooice::read(%i) - nread = %u\n", jackdata->fd, nread);
-
+    // identify the device without waiting for any input
     if (jackdata->joystick)
     {
-        if (nread != sizeof(js_event))
-        {
-            fprintf(stderr, "nooice::read(%i) - failed to read device (nread = %u)\n", jackdata->fd, nread);
-            return false;
-        }
-
-        memset(buf, 0, JackData::kBufSize);
-
         // Ask joystick to know what it is
         int vendorID=0, productID=0;
 
 #ifdef HAVE_UDEV
         if (! getVendorProductID(basename(device), &vendorID, &productID))
         {
-            fprintf(stderr, "nooice::read(%i) - failed to identify device (nread = %u)\n", jackdata->fd, nread);
+            fprintf(stderr, "nooice::open(%i) - failed to identify device\n", jackdata->fd);
         }
 #endif
 
-        if (vendorID == 1430 && productID == 4748)
+        // the generic joystick matches anything else
+        if ((jackdata->info = Devices::match(true, vendorID, productID)) == nullptr)
         {
-            jackdata->device = JackData::kGuitarHero;
-            jackdata->nread = 9;
+            fprintf(stderr, "nooice::open(%i) - unsuppported joystick %04x:%04x\n", jackdata->fd, vendorID, productID);
+            return false;
         }
-        else
-        {
-            jackdata->device = JackData::kGenericJoystick;
-
-            int n;
-
-            n = 0;
-            if (ioctl(jackdata->fd, JSIOCGAXES, &n) >= 0 && n > 0)
-                jackdata->naxes = (n > kJoystickMaxAnalog) ? kJoystickMaxAnalog : n;
-
-            n = 0;
-            if (ioctl(jackdata->fd, JSIOCGBUTTONS, &n) >= 0 && n > 0)
-                jackdata->nbuttons = (n > kJoystickMaxButton) ? kJoystickMaxButton : n;
 
-            jackdata->nread = jackdata->naxes + jackdata->nbuttons/8;
+        jackdata->nread = jackdata->info->reportSize;
+        deviceNum += 20;
 
-            printf("nooice::read(%i) - joystick has %u axes and %u buttons\n", jackdata->fd, jackdata->naxes, jackdata->nbuttons);
+        if (jackdata->options.recorder[0] != '\0')
+        {
+            unsigned char naxes = 0, nbuttons = 0;
+            ioctl(jackdata->fd, JSIOCGAXES, &naxes);
+            ioctl(jackdata->fd, JSIOCGBUTTONS, &nbuttons);
+            jackdata->recorder.setJoystick(naxes, nbuttons);
         }
-
-        deviceNum += 20;
     }
     else
     {
-        switch (nread)
+        struct hidraw_devinfo info;
+        struct hidraw_report_descriptor desc;
+        int nread = 0;
+
+        if (ioctl(jackdata->fd, HIDIOCGRAWINFO, &info) < 0)
         {
-        case 49:
-            jackdata->device = JackData::kDualShock3;
-            break;
-        case 64:
-            jackdata->device = JackData::kDualShock4;
-            break;
-        default:
-            fprintf(stderr, "nooice::read(%i) - unsuppported device (nread = %u)\n", jackdata->fd, nread);
+            fprintf(stderr, "nooice::open(%i) - failed to get hidraw device info\n", jackdata->fd);
+            return false;
+        }
+
+        desc.size = 0;
+        if (ioctl(jackdata->fd, HIDIOCGRDESCSIZE, &desc.size) >= 0 && ioctl(jackdata->fd, HIDIOCGRDESC, &desc) >= 0)
+            nread = getInputReportSize(desc.value, desc.size);
+        else
+            desc.size = 0;
+
+        // unknown IDs, try to guess from the report size
+        if ((jackdata->info = Devices::match(false, info.vendor & 0xffff, info.product & 0xffff)) == nullptr &&
+            (jackdata->info = Devices::guess(false, nread)) == nullptr)
+        {
+            fprintf(stderr, "nooice::open(%i) - unsuppported device %04x:%04x (nread = %i)\n",
+                    jackdata->fd, info.vendor & 0xffff, info.product & 0xffff, nread);
             return false;
         }
 
+        // fallback to the known report sizes if the descriptor could not be used
+        if (nread <= 0 || nread > static_cast<int>(JackData::kBufSize))
+            nread = jackdata->info->reportSize;
+
+        char name[128];
+        if (ioctl(jackdata->fd, HIDIOCGRAWNAME(sizeof(name)), name) < 0)
+            name[0] = '\0';
+
+        printf("nooice::open(%i) - \"%s\" %04x:%04x, nread = %i\n",
+               jackdata->fd, name, info.vendor & 0xffff, info.product & 0xffff, nread);
+
         jackdata->nread = nread;
+
+        if (jackdata->options.recorder[0] != '\0')
+            jackdata->recorder.setHidraw(info.vendor & 0xffff, info.product & 0xffff, desc.value, desc.size);
+    }
+
+    jackdata->device = jackdata->info->device;
+
+    if (! jackdata->info->init(jackdata))
+    {
+        fprintf(stderr, "nooice::open(%i) - failed to allocate device state\n", jackdata->fd);
+        return false;
     }
 
+    jackdata->id = deviceNum;
+    NOOICE_TRACE_INIT();
+    NOOICE_RTCHECK_INIT();
+
     char tmpName[32];
     std::snprintf(tmpName, 32, "nooice%i", deviceNum);
 
@@ -294,42 +1658,246 @@ static bool nooice_init(JackData* const jackdata, const char* const device)
         return false;
     }
 
-    switch (jackdata->device)
-    {
-    case JackData::kNull:
-        break;
-    case JackData::kDualShock3:
-        jack_port_set_alias(jackdata->midiport, "PS3 DualShock");
-        break;
-    case JackData::kDualShock4:
-        jack_port_set_alias(jackdata->midiport, "PS4 DualShock");
-        break;
-    case JackData::kGuitarHero:
-        jack_port_set_alias(jackdata->midiport, "Guitar Hero");
-        break;
-    case JackData::kGenericJoystick: {
-        char name[128];
-        if (ioctl(jackdata->fd, JSIOCGNAME(sizeof(name)), name) < 0)
-            strncpy(name, "Generic Joystick", sizeof(name));
-        jack_port_set_alias(jackdata->midiport, name);
-    }   break;
+    jackdata->midiports[0] = jackdata->midiport;
+    jackdata->nmidiports = 1;
+
+    for (unsigned i=0; i<kNumSplitGroups; ++i)
+    {
+        if ((jackdata->options.split & (1u << i)) == 0)
+            continue;
+
+        std::snprintf(tmpName, 32, "nooice_%s_%i", kSplitGroupNames[i], deviceNum);
+
+        jack_port_t* const port = jack_port_register(jackdata->client, tmpName, JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput|JackPortIsPhysical|JackPortIsTerminal, 0);
+
+        if (port == nullptr)
+        {
+            fprintf(stderr, "nooice:: failed to register jack midi port\n");
+            return false;
+        }
+
+        jackdata->midi.groupports[kSplitSticks + i] = jackdata->nmidiports;
+        jackdata->midiports[jackdata->nmidiports++] = port;
+    }
+
+    if (jackdata->options.cv)
+    {
+        const unsigned naxes = getNumAxes(jackdata);
+        jackdata->cv.count = naxes < JackData::CV::kMaxPorts ? naxes : JackData::CV::kMaxPorts;
+
+        for (unsigned i=0; i<jackdata->cv.count; ++i)
+        {
+            std::snprintf(tmpName, 32, "nooice_cv_%i_%u", deviceNum, i+1);
+
+            jackdata->cv.ports[i] = jack_port_register(jackdata->client, tmpName, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput|JackPortIsPhysical|JackPortIsTerminal, 0);
+
+            if (jackdata->cv.ports[i] == nullptr)
+            {
+                fprintf(stderr, "nooice:: failed to register jack cv port\n");
+                return false;
+            }
+        }
+    }
+
+    // without any profile options, use the default one
+    if (jackdata->nprofiles == 0)
+        jackdata->nprofiles = 1;
+
+    if (jackdata->nprofiles > 1)
+    {
+        std::snprintf(tmpName, 32, "nooice_control_%i", deviceNum);
+
+        jackdata->controlport = jack_port_register(jackdata->client, tmpName, JACK_DEFAULT_MIDI_TYPE, JackPortIsInput|JackPortIsPhysical|JackPortIsTerminal, 0);
+
+        if (jackdata->controlport == nullptr)
+        {
+            fprintf(stderr, "nooice:: failed to register jack control port\n");
+            return false;
+        }
+    }
+
+    jackdata->info->setAlias(jackdata);
+
+    if (jackdata->options.debounce != 0)
+    {
+        jackdata->debounce.hold = std::max(1u, jack_get_sample_rate(jackdata->client) * jackdata->options.debounce / 1000);
+        jackdata->debounce.deferred = jackdata->options.debouncedeferred;
+    }
+
+    if (jackdata->options.motion)
+    {
+        const DeviceInfo* const info = jackdata->info;
+
+        // the joystick interface does not give the sensors
+        if (jackdata->joystick || info->numMotionSensors != Motion::kNumSensors ||
+            info->motionSensors[Motion::kGyro] + 2u > jackdata->nread)
+        {
+            fprintf(stderr, "nooice:: this device has no motion sensors, ignoring the motion option\n");
+            jackdata->options.motion = false;
+        }
+
+        // noise filter, and how slowly gravity and the gyro rest value are followed
+        jackdata->motion.fasttau = jack_get_sample_rate(jackdata->client) / 100;
+        jackdata->motion.slowtau = jack_get_sample_rate(jackdata->client) / 2;
+    }
+
+    if (jackdata->options.touchpad)
+    {
+        const DeviceInfo* const info = jackdata->info;
+
+        if (jackdata->joystick || info->numTouches == 0 || info->touches[info->numTouches-1] + 4u > jackdata->nread)
+        {
+            fprintf(stderr, "nooice:: this device has no touchpad, ignoring the touchpad option\n");
+            jackdata->options.touchpad = false;
+        }
     }
 
-    std::memcpy(jackdata->buf, buf, jackdata->nread);
+    // until measured, assume reports arrive anywhere within a period
+    jackdata->latency.max = jack_get_buffer_size(jackdata->client);
+
+    if (jackdata->options.oscport != 0 &&
+        ! jackdata->osc.start(deviceNum, jackdata->options.oscport, jackdata->options.oscinterval))
+        return false;
+
+    if (jackdata->options.governorhigh != 0 &&
+        ! jackdata->governor.start(jackdata->client, jackdata->options.governorhigh, jackdata->options.governorlow))
+        return false;
+
+    if (jackdata->options.recorder[0] != '\0' &&
+        ! jackdata->recorder.start(jackdata->options.recorder, deviceNum, jack_get_sample_rate(jackdata->client),
+                                   &jackdata->midi.lost, &jackdata->queue.lost))
+        return false;
+
+    if (jackdata->options.governorhigh != 0 || jackdata->options.recorder[0] != '\0')
+        jack_set_xrun_callback(jackdata->client, xrun_callback, jackdata);
 
     jack_on_shutdown(jackdata->client, shutdown_callback, jackdata);
-    jack_set_process_callback(jackdata->client, process_callback, jackdata);
+    jack_set_latency_callback(jackdata->client, latency_callback, jackdata);
+    jack_set_process_callback(jackdata->client,
+                              jackdata->options.readerdecode ? process_queued_callback : jackdata->info->process,
+                              jackdata);
     jack_activate(jackdata->client);
 
     return true;
 }
 
+// generic joysticks, for each event after debouncing
+static void handleJoystickEvent(JackData* const jackdata, const js_event& ev, const jack_nframes_t time)
+{
+    if (jackdata->options.readerdecode)
+    {
+        // the process callback does not touch the joystick state in this mode
+        unsigned char tmpbuf[JackData::kBufSize];
+        GenericJoystick::push(jackdata, ev);
+        GenericJoystick::fetch(jackdata);
+        jackdata->queue.now = time;
+        jackdata->info->decode(jackdata, jackdata->queue, tmpbuf);
+
+        // only counts decoded reports here, for the tracepoints in process_queued_callback
+        const unsigned generation = jackdata->generation.fetch_add(1, std::memory_order_release) + 1;
+        NOOICE_TRACE(publish, jackdata->id, jackdata->nreports, generation);
+    }
+    else
+    {
+        pthread_mutex_lock(&jackdata->mutex);
+        GenericJoystick::push(jackdata, ev);
+        jackdata->latency.published = time;
+        const unsigned generation = jackdata->generation.fetch_add(1, std::memory_order_release) + 1;
+        pthread_mutex_unlock(&jackdata->mutex);
+
+        NOOICE_TRACE(publish, jackdata->id, jackdata->nreports, generation);
+    }
+
+    if ((ev.type & ~JS_EVENT_INIT) == JS_EVENT_AXIS && ev.number < jackdata->cv.count)
+        pushCV(jackdata, time, ev.number, (ev.value + 32768) / 65535.f);
+
+    if (jackdata->osc.isRunning())
+        pushJoystickOsc(jackdata, ev);
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+// Button debounce in the reader thread, see Debounce
+
+// generic joysticks, sends an event for each button that changed after debouncing
+static void debounceJoystick(JackData* const jackdata, const jack_nframes_t time)
+{
+    Debounce& debounce(jackdata->debounce);
+
+    uint32_t old[Debounce::kWords];
+    std::memcpy(old, debounce.stable, sizeof(old));
+
+    if (! debounce.update(time))
+        return;
+
+    js_event ev;
+    ev.time = 0;
+    ev.type = JS_EVENT_BUTTON;
+
+    for (unsigned i=0; i<Debounce::kWords; ++i)
+    {
+        for (uint32_t bits = old[i] ^ debounce.stable[i]; bits != 0; bits &= bits - 1)
+        {
+            const unsigned bit = __builtin_ctz(bits);
+
+            ev.number = i*32 + bit;
+            ev.value  = (debounce.stable[i] >> bit) & 1;
+            handleJoystickEvent(jackdata, ev, time);
+        }
+    }
+}
+
+// raw devices, takes the button bits of a new report
+static void setDebounceInput(JackData* const jackdata, const unsigned char buf[JackData::kBufSize])
+{
+    const DeviceInfo* const info = jackdata->info;
+
+    for (unsigned i=0; i<info->numButtonMasks; ++i)
+        jackdata->debounce.setByte(i, buf[info->buttonMasks[i][0]] & info->buttonMasks[i][1]);
+}
+
+// raw devices, replaces the button bits of the report with the debounced ones
+static void applyDebounce(JackData* const jackdata, unsigned char buf[JackData::kBufSize])
+{
+    const DeviceInfo* const info = jackdata->info;
+
+    for (unsigned i=0; i<info->numButtonMasks; ++i)
+    {
+        const unsigned char byte = info->buttonMasks[i][0];
+        const unsigned char mask = info->buttonMasks[i][1];
+
+        buf[byte] = (buf[byte] & ~mask) | (jackdata->debounce.getByte(i) & mask);
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------------
+
 static bool nooice_idle(JackData* const jackdata, unsigned char buf[JackData::kBufSize])
 {
     if (jackdata->client == nullptr)
         return false;
 
-    if (jackdata->joystick)
+    // a button change is held back, take it once the hold time is over even if nothing else arrives
+    bool expired = false;
+
+    if (jackdata->debounce.isWaiting())
+    {
+        // only wait for what is left of the hold time, other events must not restart it
+        const jack_nframes_t frames = jackdata->debounce.remaining(jack_frame_time(jackdata->client));
+        const jack_nframes_t rate = jack_get_sample_rate(jackdata->client);
+        const int timeout = static_cast<int>((static_cast<uint64_t>(frames) * 1000 + rate - 1) / rate);
+
+        pollfd pfd = { jackdata->fd, POLLIN, 0 };
+        expired = timeout == 0 || poll(&pfd, 1, timeout) == 0;
+
+        if (expired && jackdata->device == JackData::kGenericJoystick)
+        {
+            debounceJoystick(jackdata, jack_frame_time(jackdata->client));
+            return true;
+        }
+    }
+
+    // when expired, the previous report is used again and only the buttons can change
+    if (! expired && jackdata->joystick)
     {
         js_event ev;
         const int nread = read(jackdata->fd, &ev, sizeof(js_event));
@@ -342,6 +1910,30 @@ static bool nooice_idle(JackData* const jackdata, unsigned char buf[JackData::kB
             return false;
         }
 
+        if (jackdata->recorder.isRunning())
+            jackdata->recorder.addJoystickEvent(jack_frame_time(jackdata->client), ev.type & ~JS_EVENT_INIT, ev.number, ev.value);
+
+        if (jackdata->device == JackData::kGenericJoystick)
+        {
+            const jack_nframes_t time = jack_frame_time(jackdata->client);
+
+            ++jackdata->nreports;
+            NOOICE_TRACE(report_read, jackdata->id, jackdata->nreports, sizeof(js_event));
+            measureReportInterval(jackdata, time);
+
+            if (jackdata->debounce.hold != 0 && (ev.type & ~JS_EVENT_INIT) == JS_EVENT_BUTTON)
+            {
+                jackdata->debounce.setButton(ev.number, ev.value != 0);
+                debounceJoystick(jackdata, time);
+            }
+            else
+            {
+                handleJoystickEvent(jackdata, ev, time);
+            }
+
+            return true;
+        }
+
         // ignore synthetic events
         ev.type &= ~0x80;
 
@@ -351,11 +1943,21 @@ static bool nooice_idle(JackData* const jackdata, unsigned char buf[JackData::kB
         case 1: { // button
             if (ev.number > kJoystickMaxButton)
                 break;
-            if (jackdata->device == JackData::kGuitarHero && ev.number > 5)
-                --ev.number;
+
+            int offs = kJoystickButtonStart + (ev.number / 8);
+
+            // all of its buttons go in the single byte that GuitarHero::process reads
+            if (jackdata->device == JackData::kGuitarHero)
+            {
+                if (ev.number > 5)
+                    --ev.number;
+                if (ev.number >= 8)
+                    break;
+
+                offs = GuitarHero::kBytesButtons;
+            }
 
             const int mask = 1 << (ev.number % 8);
-            const int offs = (jackdata->naxes > 0) ? jackdata->naxes : kJoystickButtonStart + (ev.number / 8);
 
             if (ev.value)
                 buf[offs] |= mask;
@@ -373,7 +1975,7 @@ static bool nooice_idle(JackData* const jackdata, unsigned char buf[JackData::kB
         }
         }
     }
-    else
+    else if (! expired)
     {
         const int nread = read(jackdata->fd, buf, jackdata->nread);
 
@@ -384,11 +1986,71 @@ static bool nooice_idle(JackData* const jackdata, unsigned char buf[JackData::kB
             jack_deactivate(jackdata->client);
             return false;
         }
+
+        if (jackdata->recorder.isRunning())
+            jackdata->recorder.addReport(jack_frame_time(jackdata->client), buf, nread);
     }
 
-    pthread_mutex_lock(&jackdata->mutex);
-    std::memcpy(jackdata->buf, buf, jackdata->nread);
-    pthread_mutex_unlock(&jackdata->mutex);
+    const jack_nframes_t time = jack_frame_time(jackdata->client);
+
+    if (! expired)
+    {
+        ++jackdata->nreports;
+        NOOICE_TRACE(report_read, jackdata->id, jackdata->nreports, jackdata->nread);
+        measureReportInterval(jackdata, time);
+
+        if (jackdata->options.drumthreshold != 0)
+            detectOnsets(jackdata, buf, time);
+
+        if (jackdata->options.motion && jackdata->governor.level.load(std::memory_order_relaxed) < Governor::kLevelNoMotion)
+            processMotion(jackdata, buf, time);
+
+        if (jackdata->options.touchpad)
+            processTouches(jackdata, buf, time);
+    }
+
+    if (jackdata->debounce.hold != 0)
+    {
+        if (! expired)
+            setDebounceInput(jackdata, buf);
+
+        jackdata->debounce.update(time);
+        applyDebounce(jackdata, buf);
+    }
+
+    // only the reader writes to jackdata->buf, so it is safe to compare without the lock
+    const bool first = jackdata->options.readerdecode ? jackdata->nreports == 1
+                                                      : jackdata->generation.load(std::memory_order_relaxed) == 0;
+
+    if (first || ! isSameReport(jackdata, buf, jackdata->buf))
+    {
+        if (jackdata->options.readerdecode)
+        {
+            unsigned char tmpbuf[JackData::kBufSize];
+            std::memcpy(jackdata->buf, buf, jackdata->nread);
+            std::memcpy(tmpbuf, buf, jackdata->nread);
+            jackdata->queue.now = time;
+            jackdata->info->decode(jackdata, jackdata->queue, tmpbuf);
+
+            const unsigned generation = jackdata->generation.fetch_add(1, std::memory_order_release) + 1;
+            NOOICE_TRACE(publish, jackdata->id, jackdata->nreports, generation);
+        }
+        else
+        {
+            pthread_mutex_lock(&jackdata->mutex);
+            std::memcpy(jackdata->buf, buf, jackdata->nread);
+            jackdata->latency.published = time;
+            const unsigned generation = jackdata->generation.fetch_add(1, std::memory_order_release) + 1;
+            pthread_mutex_unlock(&jackdata->mutex);
+
+            NOOICE_TRACE(publish, jackdata->id, jackdata->nreports, generation);
+        }
+    }
+
+    pushReportCV(jackdata, buf, time);
+
+    if (jackdata->osc.isRunning())
+        pushReportOsc(jackdata, buf);
 
 #if 0
         printf("\n==========================================\n");
@@ -409,6 +2071,25 @@ static bool nooice_idle(JackData* const jackdata, unsigned char buf[JackData::kB
 static volatile bool gRunning;
 static JackData* gJackdata;
 
+// switch to the next profile, lock-free so it can be used from a signal handler
+static void nooice_next_profile(JackData* const jackdata)
+{
+    const MidiProfile* const profile = jackdata->profile.load(std::memory_order_relaxed);
+    const unsigned index = (profile - jackdata->profiles + 1) % jackdata->nprofiles;
+
+    jackdata->profile.store(&jackdata->profiles[index], std::memory_order_release);
+}
+
+static void profileSignalHandler(int)
+{
+    nooice_next_profile(gJackdata);
+}
+
+static void recorderSignalHandler(int)
+{
+    gJackdata->recorder.trigger(Recorder::kReasonSignal);
+}
+
 static void signalHandler(int)
 {
     gRunning = false;
@@ -422,13 +2103,48 @@ int main(int argc, char **argv)
 {
     if (argc < 2)
     {
-        printf("Usage: %s /dev/hidrawX|/dev/input/jsX\n", argv[0]);
+        printf("Usage: %s /dev/hidrawX|/dev/input/jsX [options...]\n", argv[0]);
+        printf("Options:\n");
+        printf("  cv                                   add an audio port with a control-voltage signal for each axis\n");
+        printf("  readerdecode                         decode reports in the reader thread, MIDI is sent one period later\n");
+        printf("  sysex                                send the whole state as a single SysEx message on each change,\n");
+        printf("                                       instead of CCs and notes\n");
+        printf("  debounce=MS[:deferred]               ignore button changes for MS milliseconds after each one, or\n");
+        printf("                                       with deferred, only take changes that last MS milliseconds\n");
+        printf("  drums=THRESHOLD[:RELEASE]            analog triggers also play drum notes, when rising past THRESHOLD\n");
+        printf("                                       (1-255) until falling to RELEASE, default half of THRESHOLD\n");
+        printf("  polar[=SECTORS]                      sticks also as radius and angle CCs, with X and Y stretched to\n");
+        printf("                                       a square, and notes for up to 16 direction SECTORS\n");
+        printf("  motion                               accelerometer tilt and shake, and gyro rotation, as 14-bit CCs\n");
+        printf("  touchpad                             touchpad contacts as MPE notes in the upper zone, with X as\n");
+        printf("                                       pitch bend and Y as CC74\n");
+        printf("  governor[=HIGH[:LOW]]                send fewer CCs while the DSP load is above HIGH percent (default 75)\n");
+        printf("                                       or after xruns, until it stays below LOW (default 2/3 of HIGH)\n");
+        printf("  recorder[=DIR]                       keep the last reports and MIDI events in memory, and write them\n");
+        printf("                                       to DIR (default /tmp) on SIGUSR2, xruns or lost MIDI events,\n");
+        printf("                                       for tools/nooice-replay\n");
+        printf("  chords=KEY[:SCALE]                   Guitar Hero key and scale of the fret chords (default C:major),\n");
+        printf("                                       scales are major, minor, dorian and mixolydian, holding xbox,\n");
+        printf("                                       start moves the key up a fifth and back switches the scale\n");
+        printf("  split[=GROUP,...]                    separate MIDI ports for the sticks, motion and touch groups,\n");
+        printf("                                       default all of them, buttons and drum notes stay on the main port\n");
+        printf("  osc=PORT[:INTERVAL]                  send OSC to a local UDP port, one bundle per report or every\n");
+        printf("                                       INTERVAL milliseconds\n");
+        printf("  profile=CHANNEL[:TRANSPOSE[:VELOCITY]] add a mapping profile, can be repeated\n");
+        printf("                                       with more than one, program changes on the control port\n");
+        printf("                                       or SIGUSR1 switch between them\n");
         return 1;
     }
 
     JackData jackdata;
     gJackdata = &jackdata;
 
+    for (int i=2; i<argc; ++i)
+    {
+        if (! nooice_parse_option(&jackdata, argv[i]))
+            return 1;
+    }
+
     if (! nooice_init(&jackdata, argv[1]))
         return 1;
 
@@ -442,6 +2158,12 @@ int main(int argc, char **argv)
     sigaction(SIGINT,  &sig, nullptr);
     sigaction(SIGTERM, &sig, nullptr);
 
+    sig.sa_handler = profileSignalHandler;
+    sigaction(SIGUSR1, &sig, nullptr);
+
+    sig.sa_handler = recorderSignalHandler;
+    sigaction(SIGUSR2, &sig, nullptr);
+
     unsigned char buf[JackData::kBufSize];
     memset(buf, 0, JackData::kBufSize);
     while (gRunning && nooice_idle(&jackdata, buf)) {}
@@ -489,9 +2211,31 @@ int jack_initialize(jack_client_t* client, const char* load_init)
 {
     JackData* const jackdata = new JackData();
 
+    // device path, optionally followed by space separated options
+    char args[256];
+    std::strncpy(args, load_init != nullptr ? load_init : "", sizeof(args)-1);
+    args[sizeof(args)-1] = '\0';
+
+    char* saveptr = nullptr;
+    const char* const device = strtok_r(args, " ", &saveptr);
+
+    for (const char* option; (option = strtok_r(nullptr, " ", &saveptr)) != nullptr;)
+    {
+        if (! nooice_parse_option(jackdata, option))
+        {
+            delete jackdata;
+            return 1;
+        }
+    }
+
     jackdata->client = client;
-    if (! nooice_init(jackdata, load_init))
+    if (! nooice_init(jackdata, device))
+    {
+        // the client belongs to jackd, same as in jack_finish
+        jackdata->client = nullptr;
+        delete jackdata;
         return 1;
+    }
 
     pthread_create(&jackdata->thread, nullptr, gInternalClientRun, jackdata);
     return 0;
@@ -0,0 +1,315 @@
+/*
+ * nooice - ...
+ * Copyright (C) 2016-2017 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef NOOICE_OSC_HPP_INCLUDED
+#define NOOICE_OSC_HPP_INCLUDED
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+// --------------------------------------------------------------------------------------------------------------------
+// OSC over UDP to localhost, with the axes and buttons at full resolution
+// The reader thread updates the values, a separate thread sends the changed ones as a single bundle,
+// either as soon as a report was handled or at a fixed interval.
+//
+// Messages are "/nooice/N/axis/I f" and "/nooice/N/button/I i", where N is the device number.
+
+class OscOutput {
+public:
+    static const unsigned kMaxAxes    = 256;
+    static const unsigned kMaxButtons = 256;
+
+    OscOutput() noexcept
+        : id(0),
+          interval(0),
+          sock(-1),
+          running(false),
+          ndirty(0),
+          thread(0),
+          size(0)
+    {
+        pthread_mutex_init(&mutex, nullptr);
+
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&cond, &attr);
+        pthread_condattr_destroy(&attr);
+
+        std::memset(axes, 0, sizeof(axes));
+        std::memset(buttons, 0, sizeof(buttons));
+        std::memset(dirty, 0, sizeof(dirty));
+    }
+
+    ~OscOutput()
+    {
+        stop();
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&mutex);
+    }
+
+    // interval in milliseconds, 0 sends one bundle per update
+    bool start(const int deviceId, const unsigned short port, const unsigned intervalMs)
+    {
+        sock = socket(AF_INET, SOCK_DGRAM|SOCK_CLOEXEC, 0);
+
+        if (sock < 0)
+        {
+            fprintf(stderr, "nooice:: failed to create osc socket\n");
+            return false;
+        }
+
+        sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        if (connect(sock, (const sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            fprintf(stderr, "nooice:: failed to set osc destination port %u\n", port);
+            close(sock);
+            sock = -1;
+            return false;
+        }
+
+        id = deviceId;
+        interval = intervalMs;
+        running = true;
+
+        if (pthread_create(&thread, nullptr, threadRun, this) != 0)
+        {
+            fprintf(stderr, "nooice:: failed to create osc thread\n");
+            running = false;
+            close(sock);
+            sock = -1;
+            return false;
+        }
+
+        return true;
+    }
+
+    void stop()
+    {
+        if (sock < 0)
+            return;
+
+        pthread_mutex_lock(&mutex);
+        running = false;
+        pthread_cond_signal(&cond);
+        pthread_mutex_unlock(&mutex);
+
+        pthread_join(thread, nullptr);
+        close(sock);
+        sock = -1;
+    }
+
+    bool isRunning() const noexcept
+    {
+        return sock >= 0;
+    }
+
+    // reader side, set values between beginUpdate and endUpdate
+    void beginUpdate() noexcept
+    {
+        pthread_mutex_lock(&mutex);
+    }
+
+    void setAxis(const unsigned index, const float value) noexcept
+    {
+        if (index >= kMaxAxes || axes[index] == value)
+            return;
+
+        axes[index] = value;
+        setDirty(index);
+    }
+
+    void setButton(const unsigned index, const bool value) noexcept
+    {
+        if (index >= kMaxButtons || buttons[index] == value)
+            return;
+
+        buttons[index] = value;
+        setDirty(kMaxAxes + index);
+    }
+
+    void endUpdate() noexcept
+    {
+        const bool changed = ndirty != 0;
+        pthread_mutex_unlock(&mutex);
+
+        if (changed && interval == 0)
+            pthread_cond_signal(&cond);
+    }
+
+private:
+    static const unsigned kPacketSize = 32768;
+
+    int id;
+    unsigned interval;
+    int sock;
+    bool running;
+
+    // protected by mutex
+    float axes[kMaxAxes];
+    bool buttons[kMaxButtons];
+    uint32_t dirty[(kMaxAxes + kMaxButtons) / 32];
+    unsigned ndirty;
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    // owned by the sender thread
+    char packet[kPacketSize];
+    unsigned size;
+
+    void setDirty(const unsigned index) noexcept
+    {
+        const uint32_t mask = 1u << (index % 32);
+
+        if (dirty[index / 32] & mask)
+            return;
+
+        dirty[index / 32] |= mask;
+        ++ndirty;
+    }
+
+    // OSC strings are null terminated and padded to 4 bytes
+    void addString(const char* const str, const unsigned len) noexcept
+    {
+        std::memcpy(packet + size, str, len);
+        std::memset(packet + size + len, 0, 4 - len % 4);
+        size += len + 4 - len % 4;
+    }
+
+    void addInt32(const uint32_t value) noexcept
+    {
+        const uint32_t be = htonl(value);
+        std::memcpy(packet + size, &be, 4);
+        size += 4;
+    }
+
+    void addMessage(const char* const type, const unsigned index, const char* const tag, const uint32_t value) noexcept
+    {
+        char address[48];
+        const int len = std::snprintf(address, sizeof(address), "/nooice/%i/%s/%u", id, type, index);
+
+        // bundle element size, filled in below
+        const unsigned sizepos = size;
+        size += 4;
+
+        addString(address, len);
+        addString(tag, 2);
+        addInt32(value);
+
+        const uint32_t elementSize = htonl(size - sizepos - 4);
+        std::memcpy(packet + sizepos, &elementSize, 4);
+    }
+
+    // with the lock held
+    void buildBundle() noexcept
+    {
+        size = 0;
+        addString("#bundle", 7);
+        addInt32(0);
+        addInt32(1); // "immediately" time tag
+
+        for (unsigned i=0; i<sizeof(dirty)/sizeof(dirty[0]); ++i)
+        {
+            for (uint32_t bits = dirty[i]; bits != 0; bits &= bits - 1)
+            {
+                const unsigned index = i*32 + __builtin_ctz(bits);
+
+                if (index < kMaxAxes)
+                {
+                    uint32_t value;
+                    std::memcpy(&value, &axes[index], 4);
+                    addMessage("axis", index, ",f", value);
+                }
+                else
+                {
+                    addMessage("button", index - kMaxAxes, ",i", buttons[index - kMaxAxes]);
+                }
+            }
+
+            dirty[i] = 0;
+        }
+
+        ndirty = 0;
+    }
+
+    void run()
+    {
+        timespec next;
+        clock_gettime(CLOCK_MONOTONIC, &next);
+
+        pthread_mutex_lock(&mutex);
+
+        while (running)
+        {
+            if (interval == 0)
+            {
+                if (ndirty == 0)
+                {
+                    pthread_cond_wait(&cond, &mutex);
+                    continue;
+                }
+            }
+            else
+            {
+                next.tv_nsec += long(interval % 1000) * 1000000;
+                next.tv_sec  += interval / 1000 + next.tv_nsec / 1000000000;
+                next.tv_nsec %= 1000000000;
+
+                while (running && pthread_cond_timedwait(&cond, &mutex, &next) == 0) {}
+
+                if (ndirty == 0)
+                    continue;
+            }
+
+            if (! running)
+                break;
+
+            buildBundle();
+            pthread_mutex_unlock(&mutex);
+
+            if (send(sock, packet, size, 0) < 0) {}
+
+            pthread_mutex_lock(&mutex);
+        }
+
+        pthread_mutex_unlock(&mutex);
+    }
+
+    static void* threadRun(void* const arg)
+    {
+        static_cast<OscOutput*>(arg)->run();
+        return nullptr;
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+#endif // NOOICE_OSC_HPP_INCLUDED
@@ -0,0 +1,99 @@
+/*
+ * nooice - ...
+ * Copyright (C) 2016-2017 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef NOOICE_POLAR_HPP_INCLUDED
+#define NOOICE_POLAR_HPP_INCLUDED
+
+#include <cmath>
+#include <stdint.h>
+
+// --------------------------------------------------------------------------------------------------------------------
+// Stick position as radius and angle, using fixed-point lookup tables
+// Both come from the ratio between the smaller and larger of |x| and |y|, so each conversion is a few table reads
+// and multiplies. The same ratio gives the circular-to-square factor, so that the stick reaches the corners.
+
+struct Polar {
+    static const unsigned kTurn = 4096; // angle units in a full turn
+
+    struct Position {
+        int x, y;        // stretched to a square, -128 to 127
+        unsigned radius; // 0 to 128, more in the corners of a square gate
+        unsigned angle;  // 0 to kTurn-1, counterclockwise from the right
+    };
+
+    uint16_t atan[257];  // atan(i/256), in kTurn units
+    uint16_t hypot[257]; // 256 * sqrt(1 + (i/256)^2)
+    uint16_t recip[129]; // 65536 / i
+
+    Polar() noexcept
+    {
+        for (unsigned i=0; i<=256; ++i)
+        {
+            atan[i]  = static_cast<uint16_t>(std::atan(i / 256.0) * kTurn / (2 * M_PI) + 0.5);
+            hypot[i] = static_cast<uint16_t>(std::sqrt(1.0 + (i / 256.0) * (i / 256.0)) * 256 + 0.5);
+        }
+
+        recip[0] = 0;
+        for (unsigned i=1; i<=128; ++i)
+            recip[i] = i > 1 ? 65536 / i : 65535;
+    }
+
+    // dx and dy from -128 to 128, with y going up
+    void convert(const int dx, const int dy, Position& pos) const noexcept
+    {
+        const unsigned ax = dx < 0 ? -dx : dx;
+        const unsigned ay = dy < 0 ? -dy : dy;
+        const unsigned big   = ax > ay ? ax : ay;
+        const unsigned small = ax > ay ? ay : ax;
+
+        if (big == 0)
+        {
+            pos.x = pos.y = 0;
+            pos.radius = pos.angle = 0;
+            return;
+        }
+
+        const unsigned ratio = small == big ? 256 : (small * recip[big] + 128) >> 8;
+
+        // first octant, then unfolded into the right quadrant
+        unsigned angle = ax >= ay ? atan[ratio] : kTurn/4 - atan[ratio];
+
+        if (dx < 0)
+            angle = kTurn/2 - angle;
+        if (dy < 0)
+            angle = kTurn - angle;
+
+        pos.angle  = angle % kTurn;
+        pos.radius = (big * hypot[ratio]) >> 8;
+        pos.x = stretch(dx, hypot[ratio]);
+        pos.y = stretch(dy, hypot[ratio]);
+    }
+
+private:
+    // same rounding on both sides of the center
+    static int stretch(const int value, const unsigned factor) noexcept
+    {
+        const int stretched = (value < 0 ? -1 : 1) * int((unsigned(value < 0 ? -value : value) * factor) >> 8);
+
+        return stretched < -128 ? -128 : stretched > 127 ? 127 : stretched;
+    }
+};
+
+static const Polar gPolar;
+
+// --------------------------------------------------------------------------------------------------------------------
+
+#endif // NOOICE_POLAR_HPP_INCLUDED
@@ -0,0 +1,423 @@
+/*
+ * nooice - ...
+ * Copyright (C) 2016-2017 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef NOOICE_RECORDER_HPP_INCLUDED
+#define NOOICE_RECORDER_HPP_INCLUDED
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+
+#include <jack/jack.h>
+
+// --------------------------------------------------------------------------------------------------------------------
+// Flight recorder, keeps the last reports and MIDI events in memory and writes them to a file when something
+// went wrong, in the format of tools/nooice-replay
+// Each ring has a single writer that overwrites the oldest entries, recording is a copy and an atomic store.
+// The dump runs in a separate thread, woken by trigger() on SIGUSR2 and xruns, and checking "health" (counters
+// of lost MIDI events, in the process callback and in the reader queue) a few times per second.
+// Automatic dumps are at most every kMinDumpSecs.
+
+// Overwriting ring, for one writer thread, read by the dump while it is being written
+template <typename T, unsigned kSize>
+class FlightRing {
+    static_assert((kSize & (kSize - 1)) == 0, "size must be a power of 2");
+
+public:
+    FlightRing() noexcept
+        : entries(nullptr),
+          head(0) {}
+
+    ~FlightRing()
+    {
+        delete[] entries;
+    }
+
+    void allocate()
+    {
+        entries = new T[kSize];
+    }
+
+    bool isAllocated() const noexcept
+    {
+        return entries != nullptr;
+    }
+
+    // writer side, fill in the entry and then commit it
+    T& next() noexcept
+    {
+        return entries[head.load(std::memory_order_relaxed) & (kSize - 1)];
+    }
+
+    void commit() noexcept
+    {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // copies the entries in order, without the ones that were overwritten while copying, returns their count
+    unsigned copy(T* const out) const noexcept
+    {
+        const unsigned end = head.load(std::memory_order_acquire);
+        const unsigned start = end > kSize ? end - kSize : 0;
+
+        for (unsigned i=start; i<end; ++i)
+            out[i - start] = entries[i & (kSize - 1)];
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // the writer may be in the middle of the entry after its head
+        const unsigned now = head.load(std::memory_order_relaxed);
+        const unsigned valid = now + 1 > kSize ? now + 1 - kSize : 0;
+
+        if (valid <= start)
+            return end - start;
+        if (valid >= end)
+            return 0;
+
+        std::memmove(out, out + (valid - start), sizeof(T) * (end - valid));
+        return end - valid;
+    }
+
+private:
+    T* entries;
+    std::atomic<unsigned> head;
+};
+
+class Recorder {
+public:
+    static const unsigned kMaxReportSize = 128;
+    static const unsigned kMaxMidiSize   = 16; // longer SysEx messages are cut
+    static const unsigned kReports = 4096;     // about 16 seconds at the DualShock 4 rate
+    static const unsigned kMidiEvents = 16384;
+
+    struct Report {
+        jack_nframes_t time;
+        unsigned char size; // 0 for a js event, stored in data as type, number and 16-bit value
+        unsigned char data[kMaxReportSize];
+    };
+
+    struct MidiEvent {
+        jack_nframes_t time;
+        unsigned char size;
+        unsigned char data[kMaxMidiSize];
+    };
+
+    Recorder() noexcept
+        : header(nullptr),
+          sampleRate(48000),
+          id(0),
+          running(false),
+          reasons(0),
+          thread(0),
+          reportCopy(nullptr),
+          midiCopy(nullptr),
+          ndumps(0)
+    {
+        sem_init(&sem, 0, 0);
+        std::memset(dir, 0, sizeof(dir));
+        std::memset(health, 0, sizeof(health));
+    }
+
+    ~Recorder()
+    {
+        stop();
+        sem_destroy(&sem);
+        delete[] header;
+        delete[] reportCopy;
+        delete[] midiCopy;
+    }
+
+    // first line of the dump, describing the device
+    void setHidraw(const unsigned vendor, const unsigned product, const unsigned char* const desc, const unsigned size)
+    {
+        delete[] header;
+        header = new char[32 + size*2];
+
+        int len = std::sprintf(header, "hidraw %04x:%04x ", vendor, product);
+
+        for (unsigned i=0; i<size; ++i)
+            len += std::sprintf(header + len, "%02x", desc[i]);
+    }
+
+    void setJoystick(const unsigned naxes, const unsigned nbuttons)
+    {
+        delete[] header;
+        header = new char[32];
+        std::sprintf(header, "joystick %u %u", naxes, nbuttons);
+    }
+
+    bool start(const char* const directory, const int deviceId, const jack_nframes_t rate,
+               const std::atomic<unsigned>* const midiLost, const std::atomic<unsigned>* const queueLost)
+    {
+        const size_t len = std::strlen(directory);
+
+        if (len >= sizeof(dir))
+        {
+            fprintf(stderr, "nooice:: flight recorder directory is too long\n");
+            return false;
+        }
+
+        std::memcpy(dir, directory, len + 1);
+        id = deviceId;
+        sampleRate = rate;
+        health[0] = midiLost;
+        health[1] = queueLost;
+
+        reports.allocate();
+        midi.allocate();
+        reportCopy = new Report[kReports];
+        midiCopy = new MidiEvent[kMidiEvents];
+
+        running = true;
+
+        if (pthread_create(&thread, nullptr, threadRun, this) != 0)
+        {
+            fprintf(stderr, "nooice:: failed to create flight recorder thread\n");
+            running = false;
+            return false;
+        }
+
+        return true;
+    }
+
+    void stop()
+    {
+        if (! running)
+            return;
+
+        running = false;
+        sem_post(&sem);
+        pthread_join(thread, nullptr);
+    }
+
+    bool isRunning() const noexcept
+    {
+        return running;
+    }
+
+    // reader thread
+    void addReport(const jack_nframes_t time, const unsigned char* const data, const unsigned size) noexcept
+    {
+        Report& r(reports.next());
+        r.time = time;
+        r.size = size < kMaxReportSize ? size : kMaxReportSize;
+        std::memcpy(r.data, data, r.size);
+        reports.commit();
+    }
+
+    void addJoystickEvent(const jack_nframes_t time, const unsigned char type, const unsigned char number,
+                          const int16_t value) noexcept
+    {
+        Report& r(reports.next());
+        r.time = time;
+        r.size = 0;
+        r.data[0] = type;
+        r.data[1] = number;
+        std::memcpy(r.data + 2, &value, sizeof(value));
+        reports.commit();
+    }
+
+    // process thread
+    void addMidi(const jack_nframes_t time, const unsigned char* const data, const size_t size) noexcept
+    {
+        MidiEvent& ev(midi.next());
+        ev.time = time;
+        ev.size = size < kMaxMidiSize ? size : kMaxMidiSize;
+        std::memcpy(ev.data, data, ev.size);
+        midi.commit();
+    }
+
+    enum Reason {
+        kReasonSignal = 0x1,
+        kReasonXrun   = 0x2,
+        kReasonHealth = 0x4,
+    };
+
+    // async-signal-safe
+    void trigger(const Reason reason) noexcept
+    {
+        reasons.fetch_or(reason, std::memory_order_relaxed);
+        sem_post(&sem);
+    }
+
+private:
+    static const unsigned kCheckMs = 250;
+    static const unsigned kMinDumpSecs = 10;
+
+    char dir[256];
+    char* header;
+    const std::atomic<unsigned>* health[2];
+    jack_nframes_t sampleRate;
+    int id;
+    volatile bool running;
+    std::atomic<unsigned> reasons;
+
+    FlightRing<Report, kReports> reports;
+    FlightRing<MidiEvent, kMidiEvents> midi;
+
+    pthread_t thread;
+    sem_t sem;
+
+    // owned by the dump thread
+    Report* reportCopy;
+    MidiEvent* midiCopy;
+    unsigned ndumps;
+
+    unsigned getHealth() const noexcept
+    {
+        unsigned value = 0;
+
+        for (unsigned i=0; i<sizeof(health)/sizeof(health[0]); ++i)
+        {
+            if (health[i] != nullptr)
+                value += health[i]->load(std::memory_order_relaxed);
+        }
+
+        return value;
+    }
+
+    void run()
+    {
+        unsigned lasthealth = getHealth();
+        time_t lastdump = 0;
+
+        while (running)
+        {
+            timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += long(kCheckMs) * 1000000;
+            ts.tv_sec  += ts.tv_nsec / 1000000000;
+            ts.tv_nsec %= 1000000000;
+
+            if (sem_timedwait(&sem, &ts) != 0 && errno == EINTR)
+                continue;
+
+            if (! running)
+                break;
+
+            unsigned why = reasons.exchange(0, std::memory_order_relaxed);
+
+            const unsigned newhealth = getHealth();
+
+            if (newhealth != lasthealth)
+                why |= kReasonHealth;
+
+            lasthealth = newhealth;
+
+            if (why == 0)
+                continue;
+
+            const time_t now = time(nullptr);
+
+            if ((why & kReasonSignal) == 0 && lastdump != 0 && now - lastdump < time_t(kMinDumpSecs))
+                continue;
+
+            lastdump = now;
+            dump(why, now);
+        }
+    }
+
+    void dump(const unsigned why, const time_t now)
+    {
+        char path[320];
+        char stamp[32];
+        struct tm tm;
+        localtime_r(&now, &tm);
+        std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+        std::snprintf(path, sizeof(path), "%s/nooice%i-%s-%u.replay", dir, id, stamp, ++ndumps);
+
+        FILE* const fp = std::fopen(path, "w");
+
+        if (fp == nullptr)
+        {
+            fprintf(stderr, "nooice:: failed to write flight recorder dump \"%s\"\n", path);
+            return;
+        }
+
+        const unsigned nreports = reports.copy(reportCopy);
+        const unsigned nmidi = midi.copy(midiCopy);
+
+        std::fprintf(fp, "# nooice%i flight recorder, dumped on%s%s%s\n", id,
+                     (why & kReasonSignal) ? " signal" : "",
+                     (why & kReasonXrun) ? " xrun" : "",
+                     (why & kReasonHealth) ? " lost MIDI events" : "");
+
+        if (header != nullptr)
+            std::fprintf(fp, "%s\n", header);
+
+        // times are relative to the oldest entry, both lists are already in order
+        jack_nframes_t start = 0;
+        if (nreports != 0)
+            start = reportCopy[0].time;
+        if (nmidi != 0 && (nreports == 0 || int32_t(midiCopy[0].time - start) < 0))
+            start = midiCopy[0].time;
+
+        for (unsigned r=0, m=0; r<nreports || m<nmidi;)
+        {
+            if (r < nreports && (m == nmidi || int32_t(reportCopy[r].time - midiCopy[m].time) <= 0))
+            {
+                const Report& report(reportCopy[r++]);
+                const unsigned long long usecs = getUsecs(report.time - start);
+
+                if (report.size == 0)
+                {
+                    int16_t value;
+                    std::memcpy(&value, report.data + 2, sizeof(value));
+                    std::fprintf(fp, "j %llu %u %u %i\n", usecs, report.data[0], report.data[1], value);
+                    continue;
+                }
+
+                std::fprintf(fp, "r %llu ", usecs);
+                for (unsigned i=0; i<report.size; ++i)
+                    std::fprintf(fp, "%02x", report.data[i]);
+                std::fputc('\n', fp);
+            }
+            else
+            {
+                const MidiEvent& ev(midiCopy[m++]);
+
+                std::fprintf(fp, "m %llu ", getUsecs(ev.time - start));
+                for (unsigned i=0; i<ev.size; ++i)
+                    std::fprintf(fp, "%02x", ev.data[i]);
+                std::fputc('\n', fp);
+            }
+        }
+
+        std::fclose(fp);
+        printf("nooice:: flight recorder dumped %u reports and %u MIDI events to \"%s\"\n", nreports, nmidi, path);
+    }
+
+    unsigned long long getUsecs(const jack_nframes_t frames) const noexcept
+    {
+        return static_cast<unsigned long long>(frames) * 1000000 / sampleRate;
+    }
+
+    static void* threadRun(void* const arg)
+    {
+        static_cast<Recorder*>(arg)->run();
+        return nullptr;
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+#endif // NOOICE_RECORDER_HPP_INCLUDED
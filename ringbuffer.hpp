@@ -0,0 +1,78 @@
+/*
+ * nooice - ...
+ * Copyright (C) 2016-2017 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef NOOICE_RINGBUFFER_HPP_INCLUDED
+#define NOOICE_RINGBUFFER_HPP_INCLUDED
+
+#include <atomic>
+
+// --------------------------------------------------------------------------------------------------------------------
+// Fixed-size lock-free ring buffer, for one writer thread and one reader thread
+
+template <typename T, unsigned kSize>
+class RingBuffer {
+    static_assert((kSize & (kSize - 1)) == 0, "size must be a power of 2");
+
+public:
+    RingBuffer() noexcept
+        : head(0),
+          tail(0) {}
+
+    // writer side, returns false if full
+    bool push(const T& value) noexcept
+    {
+        const unsigned h = head.load(std::memory_order_relaxed);
+
+        if (h - tail.load(std::memory_order_acquire) == kSize)
+            return false;
+
+        data[h & (kSize - 1)] = value;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // writer side, values not yet taken by the reader
+    unsigned count() const noexcept
+    {
+        return head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire);
+    }
+
+    // reader side, returns nullptr if empty
+    const T* peek() const noexcept
+    {
+        const unsigned t = tail.load(std::memory_order_relaxed);
+
+        if (t == head.load(std::memory_order_acquire))
+            return nullptr;
+
+        return &data[t & (kSize - 1)];
+    }
+
+    // reader side, must only be called after a successful peek()
+    void pop() noexcept
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    std::atomic<unsigned> head;
+    std::atomic<unsigned> tail;
+    T data[kSize];
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+#endif // NOOICE_RINGBUFFER_HPP_INCLUDED
@@ -0,0 +1,252 @@
+/*
+ * nooice - ...
+ * Copyright (C) 2016-2017 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef NOOICE_SCHEDULER_HPP_INCLUDED
+#define NOOICE_SCHEDULER_HPP_INCLUDED
+
+#include <cstring>
+#include <stdint.h>
+
+#include "midiwriter.hpp"
+
+// --------------------------------------------------------------------------------------------------------------------
+// MIDI events scheduled at absolute JACK frame times, possibly several cycles ahead
+// A timer wheel with one slot per frame, events further away than its size simply wait for more turns.
+// Events come from a fixed pool, so scheduling and sending are O(1) per event and never allocate.
+// Only to be used from the process thread.
+
+struct Scheduler {
+    static constexpr const unsigned kSlots  = 4096; // must be a power of 2
+    static constexpr const unsigned kEvents = 2048; // a full MidiQueue, plus room for strums
+    static constexpr const uint16_t kNone   = 0xFFFF;
+
+    struct Event {
+        jack_nframes_t time;
+        uint16_t next;
+        jack_midi_data_t data[3];
+        unsigned char size; // 0 when free or cancelled
+        unsigned char group;
+    };
+
+    Event pool[kEvents];
+    uint16_t heads[kSlots];
+    uint16_t tails[kSlots];
+    uint64_t occupied[kSlots/64];
+    uint16_t freelist;
+    jack_nframes_t start; // first frame of the current cycle
+    jack_nframes_t next;  // first frame of the next cycle, as expected by the last one
+    bool started;
+
+    Scheduler() noexcept
+        : freelist(0),
+          start(0),
+          next(0),
+          started(false)
+    {
+        for (unsigned i=0; i<kEvents; ++i)
+        {
+            pool[i].next = i+1 < kEvents ? i+1 : kNone;
+            pool[i].size = 0;
+        }
+
+        std::memset(heads, 0xFF, sizeof(heads));
+        std::memset(tails, 0xFF, sizeof(tails));
+        std::memset(occupied, 0, sizeof(occupied));
+    }
+
+    // to be called at the start of each cycle, before any schedule()
+    void begin(const jack_nframes_t cycleStart) noexcept
+    {
+        start = cycleStart;
+    }
+
+    // events in the past are sent as soon as possible, returns false if the pool is exhausted
+    bool schedule(jack_nframes_t time, const jack_midi_data_t* const data, const size_t size,
+                  const SplitGroup group = kSplitNone) noexcept
+    {
+        if (freelist == kNone || size == 0 || size > 3)
+            return false;
+
+        if (int32_t(time - start) < 0)
+            time = start;
+
+        const uint16_t index = freelist;
+        Event& ev(pool[index]);
+        freelist = ev.next;
+
+        ev.time = time;
+        ev.next = kNone;
+        ev.size = size;
+        ev.group = group;
+        std::memcpy(ev.data, data, size);
+
+        const unsigned slot = time & (kSlots-1);
+
+        if (heads[slot] == kNone)
+        {
+            heads[slot] = index;
+            occupied[slot/64] |= uint64_t(1) << (slot%64);
+        }
+        else
+        {
+            pool[tails[slot]].next = index;
+        }
+
+        tails[slot] = index;
+        return true;
+    }
+
+    // drop pending note-ons for a note, returns true if any was found
+    bool cancelNote(const jack_midi_data_t status, const jack_midi_data_t note) noexcept
+    {
+        bool found = false;
+
+        for (unsigned i=0; i<kEvents; ++i)
+        {
+            Event& ev(pool[i]);
+
+            if (ev.size == 3 && ev.data[0] == status && ev.data[1] == note && ev.data[2] != 0)
+            {
+                // freed when its slot is reached
+                ev.size = 0;
+                found = true;
+            }
+        }
+
+        return found;
+    }
+
+    // send everything due in the current cycle, to be called at the end of it
+    void run(MidiWriter& midi, const jack_nframes_t frames) noexcept
+    {
+        // cycles were skipped, send what is overdue right away
+        if (started && int32_t(start - next) > 0)
+        {
+            for (unsigned w=0; w<kSlots/64; ++w)
+            {
+                for (uint64_t bits = occupied[w]; bits != 0; bits &= bits - 1)
+                    fire(midi, w*64 + __builtin_ctzll(bits), start, true);
+            }
+        }
+
+        const jack_nframes_t end = start + frames;
+
+        for (jack_nframes_t frame = start; frame != end;)
+        {
+            const unsigned slot = frame & (kSlots-1);
+            const uint64_t bits = occupied[slot/64] >> (slot%64);
+            const jack_nframes_t remaining = end - frame;
+
+            if (bits == 0)
+            {
+                const jack_nframes_t skip = 64 - slot%64;
+                frame += skip < remaining ? skip : remaining;
+                continue;
+            }
+
+            const jack_nframes_t skip = __builtin_ctzll(bits);
+
+            if (skip >= remaining)
+                break;
+
+            frame += skip;
+            fire(midi, frame & (kSlots-1), frame, false);
+            ++frame;
+        }
+
+        next = end;
+        started = true;
+    }
+
+private:
+    // send the events of a slot that are due at frame (or before it, if overdue), keeping the others in order
+    void fire(MidiWriter& midi, const unsigned slot, const jack_nframes_t frame, const bool overdue) noexcept
+    {
+        uint16_t index = heads[slot];
+        uint16_t head = kNone, tail = kNone;
+
+        while (index != kNone)
+        {
+            Event& ev(pool[index]);
+            const uint16_t evnext = ev.next;
+            const bool due = overdue ? int32_t(ev.time - frame) < 0 : ev.time == frame;
+
+            if (due || ev.size == 0)
+            {
+                if (ev.size != 0)
+                    midi.write(frame - start, ev.data, ev.size, SplitGroup(ev.group));
+
+                ev.size = 0;
+                ev.next = freelist;
+                freelist = index;
+            }
+            else
+            {
+                ev.next = kNone;
+
+                if (head == kNone)
+                    head = index;
+                else
+                    pool[tail].next = index;
+
+                tail = index;
+            }
+
+            index = evnext;
+        }
+
+        heads[slot] = head;
+        tails[slot] = tail;
+
+        if (head == kNone)
+            occupied[slot/64] &= ~(uint64_t(1) << (slot%64));
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// What the devices write to when decoding in the process callback
+
+struct CycleWriter {
+    MidiWriter& midi;
+    Scheduler& scheduler;
+
+    CycleWriter(MidiWriter& m, Scheduler& s) noexcept
+        : midi(m),
+          scheduler(s) {}
+
+    bool write(const jack_nframes_t time, const jack_midi_data_t* const data, const size_t size,
+               const SplitGroup group = kSplitNone) noexcept
+    {
+        return midi.write(time, data, size, group);
+    }
+
+    // frames from the start of the current cycle, can be past its end
+    bool writeLater(const jack_nframes_t delay, const jack_midi_data_t* const data, const size_t size,
+                    const SplitGroup group = kSplitNone) noexcept
+    {
+        return scheduler.schedule(scheduler.start + delay, data, size, group);
+    }
+
+    // returns true if a pending note-on was found, in which case the note-off is not needed
+    bool cancelNote(const jack_midi_data_t status, const jack_midi_data_t note) noexcept
+    {
+        return scheduler.cancelNote(status, note);
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+#endif // NOOICE_SCHEDULER_HPP_INCLUDED
@@ -0,0 +1,190 @@
+/*
+ * nooice - ...
+ * Copyright (C) 2016-2017 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef NOOICE_SYSEX_HPP_INCLUDED
+#define NOOICE_SYSEX_HPP_INCLUDED
+
+#include <cstring>
+#include <stdint.h>
+
+#include "midiwriter.hpp"
+
+struct JackData;
+
+// --------------------------------------------------------------------------------------------------------------------
+// The whole device state as a single SysEx message, sent instead of CCs and notes when a report changes
+//
+// F0 7D <device number & 0x7F> <packed data> F7
+//
+// The data is packed 7 bytes at a time, each group starts with a byte holding the top bits of the next 7
+// (bit 0 for the first one), followed by those 7 bytes with the top bit cleared.
+// Unpacked, it contains:
+//  - number of axes, 2 bytes big-endian
+//  - number of button bytes, 1 byte
+//  - changed fields, one bit per axis then one per button byte, LSB first, all set in the first message
+//  - axes, 2 bytes big-endian each, 0 to 65535
+//  - buttons, 8 per byte, LSB first
+// Only to be used from the process thread.
+
+struct SysExSnapshot {
+    static const unsigned kMaxAxes        = 256;
+    static const unsigned kMaxButtonBytes = 32;
+    static const unsigned kMaxMaskBytes   = (kMaxAxes + kMaxButtonBytes + 7) / 8;
+    static const unsigned kMaxDataSize    = 3 + kMaxMaskBytes + kMaxAxes*2 + kMaxButtonBytes;
+    static const unsigned kMaxMessageSize = 3 + (kMaxDataSize + 6) / 7 * 8 + 1;
+
+    // current state, set by the device before write()
+    unsigned naxes, nbuttonbytes;
+    uint16_t axes[kMaxAxes];
+    unsigned char buttons[kMaxButtonBytes];
+
+    // the last write() did not fit, the process callback tries again each cycle until it does
+    // Nothing is lost meanwhile, each message carries the whole state.
+    bool pending;
+
+    SysExSnapshot() noexcept
+        : naxes(0),
+          nbuttonbytes(0),
+          pending(false),
+          started(false)
+    {
+        std::memset(axes, 0, sizeof(axes));
+        std::memset(buttons, 0, sizeof(buttons));
+        std::memset(sentaxes, 0, sizeof(sentaxes));
+        std::memset(sentbuttons, 0, sizeof(sentbuttons));
+    }
+
+    // for devices that keep their state in the report, with 8-bit axes
+    template <class Device>
+    void setReport(const JackData* const jackdata, const unsigned char* const buf) noexcept
+    {
+        naxes = Device::getNumAxes(jackdata);
+        nbuttonbytes = Device::kNumButtonBytes;
+
+        for (unsigned i=0; i<naxes; ++i)
+            axes[i] = buf[Device::getAxisByte(i)] * 257;
+
+        for (unsigned i=0; i<nbuttonbytes; ++i)
+            buttons[i] = Device::getButtonByte(buf, i);
+    }
+
+    void setButton(const unsigned index, const bool pressed) noexcept
+    {
+        if (pressed)
+            buttons[index / 8] |= 1 << (index % 8);
+        else
+            buttons[index / 8] &= ~(1 << (index % 8));
+    }
+
+    // sends the state if anything changed since the last message, returns false if it did not fit
+    bool write(MidiWriter& midi, const jack_nframes_t time, const int deviceId) noexcept
+    {
+        unsigned char data[kMaxDataSize];
+        const unsigned nmask = (naxes + nbuttonbytes + 7) / 8;
+        unsigned char* const mask = data + 3;
+        bool changed = ! started;
+
+        data[0] = naxes >> 8;
+        data[1] = naxes & 0xFF;
+        data[2] = nbuttonbytes;
+        std::memset(mask, 0, nmask);
+
+        unsigned size = 3 + nmask;
+
+        for (unsigned i=0; i<naxes; ++i)
+        {
+            if (! started || axes[i] != sentaxes[i])
+            {
+                mask[i / 8] |= 1 << (i % 8);
+                changed = true;
+            }
+
+            data[size++] = axes[i] >> 8;
+            data[size++] = axes[i] & 0xFF;
+        }
+
+        for (unsigned i=0, bit=naxes; i<nbuttonbytes; ++i, ++bit)
+        {
+            if (! started || buttons[i] != sentbuttons[i])
+            {
+                mask[bit / 8] |= 1 << (bit % 8);
+                changed = true;
+            }
+
+            data[size++] = buttons[i];
+        }
+
+        if (! changed)
+        {
+            pending = false;
+            return true;
+        }
+
+        const unsigned msgsize = pack(data, size, deviceId);
+
+        // a later cycle sends it, with the state as it is by then
+        if (! midi.fits(msgsize))
+        {
+            pending = true;
+            return false;
+        }
+
+        if (! midi.write(time, message, msgsize))
+            return false;
+
+        std::memcpy(sentaxes, axes, sizeof(uint16_t)*naxes);
+        std::memcpy(sentbuttons, buttons, nbuttonbytes);
+        started = true;
+        pending = false;
+        return true;
+    }
+
+private:
+    // as last sent
+    uint16_t sentaxes[kMaxAxes];
+    unsigned char sentbuttons[kMaxButtonBytes];
+    bool started;
+
+    jack_midi_data_t message[kMaxMessageSize];
+
+    unsigned pack(const unsigned char* const data, const unsigned size, const int deviceId) noexcept
+    {
+        unsigned pos = 0;
+
+        message[pos++] = 0xF0;
+        message[pos++] = 0x7D; // non-commercial
+        message[pos++] = deviceId & 0x7F;
+
+        for (unsigned i=0; i<size; i += 7)
+        {
+            jack_midi_data_t& msbs(message[pos++]);
+            msbs = 0;
+
+            for (unsigned j=0; j<7 && i+j<size; ++j)
+            {
+                msbs |= (data[i+j] >> 7) << j;
+                message[pos++] = data[i+j] & 0x7F;
+            }
+        }
+
+        message[pos++] = 0xF7;
+        return pos;
+    }
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+
+#endif // NOOICE_SYSEX_HPP_INCLUDED
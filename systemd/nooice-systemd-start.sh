@@ -15,4 +15,7 @@ fi
 
 CLIENT_NAME="nooice${CLIENT_NUMB}"
 
-exec /usr/bin/jack_load -a -w -i ${DEVICE_PATH} ${CLIENT_NAME} ${MODULE_NAME}
+# extra options for all devices, run "nooice" without arguments for a list
+LOAD_INIT="${DEVICE_PATH} ${NOOICE_OPTIONS}"
+
+exec /usr/bin/jack_load -a -w -i "${LOAD_INIT}" ${CLIENT_NAME} ${MODULE_NAME}
@@ -0,0 +1,140 @@
+#!/bin/bash
+# nooice - scalability benchmark, many nooice internal clients in one jackd using the dummy backend
+# Needs "make bench" first, jackd with jack_load, and access to /dev/uhid and /dev/uinput (usually root).
+#
+# Usage: tools/benchmark.sh [SECONDS] [PERIODS] [COUNTS] [WORKLOAD...]
+#   SECONDS   how long to measure each run, default 10
+#   PERIODS   period sizes, default "64 128 256 1024"
+#   COUNTS    numbers of nooice instances, default "1 4 16 64"
+#   WORKLOAD  nooice-replay arguments for each virtual device, default "--ds4 250"
+#
+# Each run starts a new jackd, creates one virtual device per instance and loads nooice.so for each of them.
+# Prints one CSV line per run, with DSP load and xruns from tools/nooice-jackstats, plus the threads and
+# resident memory that the instances added to jackd.
+
+set -e
+
+cd "$(dirname "${0}")/.."
+
+SECONDS_PER_RUN=${1:-10}
+PERIODS=${2:-64 128 256 1024}
+COUNTS=${3:-1 4 16 64}
+WORKLOAD=(--ds4 250)
+
+if [ $# -gt 3 ]; then
+    WORKLOAD=("${@:4}")
+fi
+
+SERVER=nooice-bench
+
+if [ ! -f nooice.so ] || [ ! -x tools/nooice-replay ] || [ ! -x tools/nooice-jackstats ]; then
+    echo "please run 'make bench' first"
+    exit 1
+fi
+
+JACKD_PID=""
+REPLAY_PIDS=()
+TMPDIR=$(mktemp -d)
+
+stop_run() {
+    for pid in "${REPLAY_PIDS[@]}"; do
+        kill "${pid}" 2>/dev/null || true
+    done
+    for pid in "${REPLAY_PIDS[@]}"; do
+        wait "${pid}" 2>/dev/null || true
+    done
+    REPLAY_PIDS=()
+
+    if [ -n "${JACKD_PID}" ]; then
+        kill "${JACKD_PID}" 2>/dev/null || true
+        wait "${JACKD_PID}" 2>/dev/null || true
+        JACKD_PID=""
+    fi
+}
+
+cleanup() {
+    stop_run
+    rm -rf "${TMPDIR}"
+}
+trap cleanup EXIT
+
+export JACK_DEFAULT_SERVER=${SERVER}
+
+# proc_status PID FIELD
+proc_status() {
+    awk -v field="${2}:" '$1 == field { print $2 }' "/proc/${1}/status"
+}
+
+# run_benchmark PERIOD COUNT
+run_benchmark() {
+    local period="${1}"
+    local count="${2}"
+
+    jackd -n "${SERVER}" -d dummy -r 48000 -p "${period}" >"${TMPDIR}/jackd.log" 2>&1 &
+    JACKD_PID=$!
+    sleep 2
+
+    if ! kill -0 "${JACKD_PID}" 2>/dev/null; then
+        echo "failed to start jackd with period ${period}" >&2
+        JACKD_PID=""
+        return 1
+    fi
+
+    local threads0 rss0
+    threads0=$(proc_status "${JACKD_PID}" Threads)
+    rss0=$(proc_status "${JACKD_PID}" VmRSS)
+
+    local i device
+    for ((i = 1; i <= count; ++i)); do
+        tools/nooice-replay "${WORKLOAD[@]}" >"${TMPDIR}/device${i}" 2>/dev/null &
+        REPLAY_PIDS+=($!)
+
+        device=""
+        for _ in $(seq 50); do
+            read -r device <"${TMPDIR}/device${i}" || true
+            [ -n "${device}" ] && break
+            sleep 0.1
+        done
+
+        if [ -z "${device}" ]; then
+            echo "failed to create virtual device ${i}" >&2
+            stop_run
+            return 1
+        fi
+
+        if ! jack_load "nooice-bench-${i}" "${PWD}/nooice.so" -i "${device}" >/dev/null 2>&1; then
+            echo "failed to load nooice instance ${i} for ${device}" >&2
+            stop_run
+            return 1
+        fi
+    done
+
+    # let the readers and the server settle
+    sleep 1
+
+    local threads1 rss1 stats
+    threads1=$(proc_status "${JACKD_PID}" Threads)
+    rss1=$(proc_status "${JACKD_PID}" VmRSS)
+    stats=$(tools/nooice-jackstats "${SECONDS_PER_RUN}")
+
+    # period=.. rate=.. load_avg=.. load_max=.. xruns=.. max_delay_us=..
+    local load_avg load_max xruns max_delay
+    load_avg=$(echo "${stats}" | sed -n 's/.*load_avg=\([^ ]*\).*/\1/p')
+    load_max=$(echo "${stats}" | sed -n 's/.*load_max=\([^ ]*\).*/\1/p')
+    xruns=$(echo "${stats}" | sed -n 's/.*xruns=\([^ ]*\).*/\1/p')
+    max_delay=$(echo "${stats}" | sed -n 's/.*max_delay_us=\([^ ]*\).*/\1/p')
+
+    echo "${period},${count},${load_avg},${load_max},${xruns},${max_delay}," \
+         "$((threads1 - threads0)),$(((threads1 - threads0) / count))," \
+         "$((rss1 - rss0)),$(((rss1 - rss0) / count))" | tr -d ' '
+
+    stop_run
+}
+
+echo "period,instances,load_avg,load_max,xruns,max_delay_us,threads,threads_per_instance,rss_kb,rss_kb_per_instance"
+
+for period in ${PERIODS}; do
+    for count in ${COUNTS}; do
+        run_benchmark "${period}" "${count}" || true
+    done
+done
@@ -0,0 +1,107 @@
+/*
+ * nooice - ...
+ * Copyright (C) 2016-2017 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Samples the load of a running JACK server for a while, then prints a single line:
+ *   period=<frames> rate=<Hz> load_avg=<%> load_max=<%> xruns=<count> max_delay_us=<usecs>
+ * Used by tools/benchmark.sh, can also be run on its own:
+ *   tools/nooice-jackstats [SECONDS]
+ */
+
+#define _GNU_SOURCE
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <jack/jack.h>
+#include <jack/statistics.h>
+
+static volatile int gRunning = 1;
+static volatile unsigned gXruns = 0;
+
+static void signalHandler(int sig)
+{
+    (void)sig;
+    gRunning = 0;
+}
+
+static int xrunCallback(void* arg)
+{
+    (void)arg;
+    ++gXruns;
+    return 0;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+
+int main(int argc, char** argv)
+{
+    const int seconds = argc > 1 ? atoi(argv[1]) : 10;
+
+    if (seconds < 1)
+    {
+        printf("Usage: %s [SECONDS]\n", argv[0]);
+        return 1;
+    }
+
+    jack_client_t* const client = jack_client_open("nooice-jackstats", JackNoStartServer, NULL);
+
+    if (client == NULL)
+    {
+        fprintf(stderr, "nooice-jackstats: failed to connect to jack\n");
+        return 1;
+    }
+
+    struct sigaction sig;
+    sig.sa_handler = signalHandler;
+    sig.sa_flags   = 0;
+    sigemptyset(&sig.sa_mask);
+    sigaction(SIGINT,  &sig, NULL);
+    sigaction(SIGTERM, &sig, NULL);
+
+    jack_set_xrun_callback(client, xrunCallback, NULL);
+    jack_activate(client);
+
+    /* let the graph settle after activation before counting anything */
+    usleep(500000);
+    jack_reset_max_delayed_usecs(client);
+    gXruns = 0;
+
+    double sum = 0.0, max = 0.0;
+    unsigned count = 0;
+
+    for (int i = 0; i < seconds * 10 && gRunning; ++i)
+    {
+        usleep(100000);
+
+        const double load = jack_cpu_load(client);
+
+        sum += load;
+        if (load > max)
+            max = load;
+        ++count;
+    }
+
+    printf("period=%u rate=%u load_avg=%.2f load_max=%.2f xruns=%u max_delay_us=%.0f\n",
+           jack_get_buffer_size(client), jack_get_sample_rate(client),
+           count != 0 ? sum / count : 0.0, max, gXruns, jack_get_max_delayed_usecs(client));
+
+    jack_deactivate(client);
+    jack_client_close(client);
+    return 0;
+}
@@ -0,0 +1,545 @@
+/*
+ * nooice - ...
+ * Copyright (C) 2016-2017 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Creates a virtual device for nooice to open, fed from a recording or with synthetic data.
+ * hidraw devices are created with uhid, js devices with uinput.
+ * The path of the new device is printed on stdout as soon as it is available.
+ *
+ * Replay file format, one item per line:
+ *   # comment
+ *   hidraw VVVV:PPPP <report descriptor as hex>
+ *   joystick <axes> <buttons>
+ *   r <usecs> <report as hex>                  (hidraw input report, including report ID)
+ *   j <usecs> <type> <number> <value>          (js event, type 1 is button and 2 is axis)
+ *   m <usecs> <MIDI event as hex>              (MIDI sent by nooice, ignored here)
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+#include <linux/joystick.h>
+#include <linux/uhid.h>
+#include <linux/uinput.h>
+
+#define MAX_AXES    41  /* ABS_X to ABS_MISC */
+#define MAX_BUTTONS 255
+
+static volatile int gRunning = 1;
+
+static void signalHandler(int sig)
+{
+    (void)sig;
+    gRunning = 0;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+
+static uint64_t getTimeUsecs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sleepUntil(const uint64_t usecs)
+{
+    struct timespec ts;
+    ts.tv_sec  = usecs / 1000000;
+    ts.tv_nsec = (usecs % 1000000) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && gRunning) {}
+}
+
+static int parseHex(const char* str, unsigned char* const data, const int maxsize)
+{
+    int size = 0;
+    unsigned value;
+
+    while (size < maxsize && sscanf(str, " %2x", &value) == 1)
+    {
+        data[size++] = value;
+        while (*str == ' ') ++str;
+        str += 2;
+    }
+
+    return size;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+/* uhid, for hidraw devices */
+
+static int uhidCreate(const int vendor, const int product, const unsigned char* const desc, const int descsize)
+{
+    const int fd = open("/dev/uhid", O_RDWR|O_CLOEXEC);
+
+    if (fd < 0)
+    {
+        fprintf(stderr, "nooice-replay: failed to open /dev/uhid\n");
+        return -1;
+    }
+
+    struct uhid_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_CREATE2;
+    snprintf((char*)ev.u.create2.name, sizeof(ev.u.create2.name), "nooice-replay %04x:%04x", vendor, product);
+    snprintf((char*)ev.u.create2.uniq, sizeof(ev.u.create2.uniq), "nooice-replay-%d", getpid());
+    memcpy(ev.u.create2.rd_data, desc, descsize);
+    ev.u.create2.rd_size = descsize;
+    ev.u.create2.bus     = BUS_VIRTUAL; /* so that vendor drivers do not bind to it */
+    ev.u.create2.vendor  = vendor;
+    ev.u.create2.product = product;
+
+    if (write(fd, &ev, sizeof(ev)) != sizeof(ev))
+    {
+        fprintf(stderr, "nooice-replay: failed to create uhid device\n");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int uhidInput(const int fd, const unsigned char* const data, const int size)
+{
+    struct uhid_event ev;
+    memset(&ev, 0, sizeof(ev.type) + sizeof(ev.u.input2));
+    ev.type = UHID_INPUT2;
+    ev.u.input2.size = size;
+    memcpy(ev.u.input2.data, data, size);
+
+    return write(fd, &ev, sizeof(ev)) == sizeof(ev) ? 0 : -1;
+}
+
+static void uhidDestroy(const int fd)
+{
+    struct uhid_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_DESTROY;
+
+    if (write(fd, &ev, sizeof(ev)) < 0) {}
+    close(fd);
+}
+
+/* find our hidraw node through the uniq string given on creation */
+static int printHidrawPath(void)
+{
+    char uniq[64], path[300], line[256];
+    snprintf(uniq, sizeof(uniq), "HID_UNIQ=nooice-replay-%d", getpid());
+
+    for (int tries = 0; tries < 300 && gRunning; ++tries, usleep(10000))
+    {
+        DIR* const dir = opendir("/sys/class/hidraw");
+        if (dir == NULL)
+            continue;
+
+        for (struct dirent* ent; (ent = readdir(dir)) != NULL;)
+        {
+            if (strncmp(ent->d_name, "hidraw", 6) != 0)
+                continue;
+
+            snprintf(path, sizeof(path), "/sys/class/hidraw/%s/device/uevent", ent->d_name);
+            FILE* const fp = fopen(path, "r");
+            if (fp == NULL)
+                continue;
+
+            int found = 0;
+            while (fgets(line, sizeof(line), fp) != NULL)
+                if (strncmp(line, uniq, strlen(uniq)) == 0 && (line[strlen(uniq)] == '\n' || line[strlen(uniq)] == '\0'))
+                    found = 1;
+            fclose(fp);
+
+            if (found)
+            {
+                snprintf(path, sizeof(path), "/dev/%s", ent->d_name);
+                closedir(dir);
+
+                /* wait for udev to set up the device node */
+                for (int i = 0; i < 100 && access(path, R_OK) != 0; ++i)
+                    usleep(10000);
+
+                printf("%s\n", path);
+                fflush(stdout);
+                return 0;
+            }
+        }
+
+        closedir(dir);
+    }
+
+    fprintf(stderr, "nooice-replay: hidraw device did not show up\n");
+    return -1;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+/* uinput, for js devices; axis N uses ABS code N and button N uses BTN_JOYSTICK+N, matching the js numbering */
+
+static int uinputCreate(const int naxes, const int nbuttons)
+{
+    const int fd = open("/dev/uinput", O_WRONLY|O_CLOEXEC);
+
+    if (fd < 0)
+    {
+        fprintf(stderr, "nooice-replay: failed to open /dev/uinput\n");
+        return -1;
+    }
+
+    ioctl(fd, UI_SET_EVBIT, EV_SYN);
+    ioctl(fd, UI_SET_EVBIT, EV_KEY);
+    ioctl(fd, UI_SET_EVBIT, EV_ABS);
+
+    for (int i = 0; i < nbuttons; ++i)
+        ioctl(fd, UI_SET_KEYBIT, BTN_JOYSTICK + i);
+
+    for (int i = 0; i < naxes; ++i)
+    {
+        struct uinput_abs_setup abs;
+        memset(&abs, 0, sizeof(abs));
+        abs.code = i;
+        abs.absinfo.minimum = -32767;
+        abs.absinfo.maximum = 32767;
+        ioctl(fd, UI_ABS_SETUP, &abs);
+    }
+
+    struct uinput_setup setup;
+    memset(&setup, 0, sizeof(setup));
+    snprintf(setup.name, sizeof(setup.name), "nooice-replay joystick");
+    setup.id.bustype = BUS_VIRTUAL;
+    setup.id.vendor  = 0x1209;
+    setup.id.product = 0x0001;
+
+    if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0)
+    {
+        fprintf(stderr, "nooice-replay: failed to create uinput device\n");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int uinputEvent(const int fd, const int type, const int number, const int value)
+{
+    struct input_event ev[2];
+    memset(ev, 0, sizeof(ev));
+
+    ev[0].type  = type == 1 ? EV_KEY : EV_ABS;
+    ev[0].code  = type == 1 ? BTN_JOYSTICK + number : number;
+    ev[0].value = value;
+    ev[1].type  = EV_SYN;
+    ev[1].code  = SYN_REPORT;
+
+    return write(fd, ev, sizeof(ev)) == sizeof(ev) ? 0 : -1;
+}
+
+static void uinputDestroy(const int fd)
+{
+    ioctl(fd, UI_DEV_DESTROY);
+    close(fd);
+}
+
+static int printJoystickPath(const int fd)
+{
+    char sysname[64], path[300];
+
+    if (ioctl(fd, UI_GET_SYSNAME(sizeof(sysname)), sysname) < 0)
+    {
+        fprintf(stderr, "nooice-replay: failed to get uinput device name\n");
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "/sys/devices/virtual/input/%s", sysname);
+
+    for (int tries = 0; tries < 300 && gRunning; ++tries, usleep(10000))
+    {
+        DIR* const dir = opendir(path);
+        if (dir == NULL)
+            continue;
+
+        for (struct dirent* ent; (ent = readdir(dir)) != NULL;)
+        {
+            if (strncmp(ent->d_name, "js", 2) != 0)
+                continue;
+
+            snprintf(path, sizeof(path), "/dev/input/%s", ent->d_name);
+            closedir(dir);
+
+            for (int i = 0; i < 100 && access(path, R_OK) != 0; ++i)
+                usleep(10000);
+
+            printf("%s\n", path);
+            fflush(stdout);
+            return 0;
+        }
+
+        closedir(dir);
+    }
+
+    fprintf(stderr, "nooice-replay: js device did not show up\n");
+    return -1;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+
+static int replayFile(const char* const filename, const int loop)
+{
+    static char line[16384];
+    static unsigned char data[HID_MAX_DESCRIPTOR_SIZE];
+
+    FILE* const fp = fopen(filename, "r");
+
+    if (fp == NULL)
+    {
+        fprintf(stderr, "nooice-replay: failed to open \"%s\"\n", filename);
+        return 1;
+    }
+
+    int uhid = -1, uinput = -1, ret = 0;
+    long dataStart = -1;
+    uint64_t start = 0, offset = 0, lastTime = 0;
+
+    while (gRunning)
+    {
+        if (fgets(line, sizeof(line), fp) == NULL)
+        {
+            if (! loop || dataStart < 0)
+                break;
+
+            /* start over, keeping time going forwards */
+            fseek(fp, dataStart, SEEK_SET);
+            offset += lastTime + 1000;
+            continue;
+        }
+
+        const char type = line[0];
+        uint64_t usecs;
+        int n;
+
+        if (strncmp(line, "hidraw ", 7) == 0 && uhid < 0 && uinput < 0)
+        {
+            unsigned vendor, product;
+
+            if (sscanf(line + 7, "%x:%x %n", &vendor, &product, &n) != 2)
+                continue;
+
+            const int descsize = parseHex(line + 7 + n, data, sizeof(data));
+
+            if ((uhid = uhidCreate(vendor, product, data, descsize)) < 0 || printHidrawPath() != 0)
+            {
+                ret = 1;
+                break;
+            }
+
+            dataStart = ftell(fp);
+            start = getTimeUsecs();
+        }
+        else if (strncmp(line, "joystick ", 9) == 0 && uhid < 0 && uinput < 0)
+        {
+            int naxes, nbuttons;
+
+            if (sscanf(line + 9, "%d %d", &naxes, &nbuttons) != 2)
+                continue;
+
+            if (naxes > MAX_AXES)
+                naxes = MAX_AXES;
+            if (nbuttons > MAX_BUTTONS)
+                nbuttons = MAX_BUTTONS;
+
+            if ((uinput = uinputCreate(naxes, nbuttons)) < 0 || printJoystickPath(uinput) != 0)
+            {
+                ret = 1;
+                break;
+            }
+
+            dataStart = ftell(fp);
+            start = getTimeUsecs();
+        }
+        else if (type == 'r' && uhid >= 0 && sscanf(line + 1, " %llu %n", (unsigned long long*)&usecs, &n) == 1)
+        {
+            const int size = parseHex(line + 1 + n, data, sizeof(data));
+
+            sleepUntil(start + offset + usecs);
+            uhidInput(uhid, data, size);
+            lastTime = usecs;
+        }
+        else if (type == 'j' && uinput >= 0)
+        {
+            int evtype, number, value;
+
+            if (sscanf(line + 1, " %llu %d %d %d", (unsigned long long*)&usecs, &evtype, &number, &value) != 4)
+                continue;
+
+            sleepUntil(start + offset + usecs);
+            /* older dumps kept the initial state flag */
+            uinputEvent(uinput, evtype & ~JS_EVENT_INIT, number, value);
+            lastTime = usecs;
+        }
+    }
+
+    fclose(fp);
+
+    if (uhid >= 0)
+        uhidDestroy(uhid);
+    if (uinput >= 0)
+        uinputDestroy(uinput);
+
+    return ret;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+/* synthetic data */
+
+static int synthJoystick(const int naxes, const int nbuttons, const int rate, const int seconds)
+{
+    const int fd = uinputCreate(naxes, nbuttons);
+
+    if (fd < 0 || printJoystickPath(fd) != 0)
+        return 1;
+
+    const uint64_t start = getTimeUsecs();
+    const uint64_t end   = seconds > 0 ? start + (uint64_t)seconds * 1000000 : UINT64_MAX;
+    unsigned char* const buttons = calloc(nbuttons + 1, 1);
+
+    for (uint64_t i = 1, now = start; gRunning && now < end; ++i)
+    {
+        const int n = rand() % (naxes + nbuttons);
+
+        if (n < naxes)
+        {
+            uinputEvent(fd, 2, n, (rand() % 65535) - 32767);
+        }
+        else
+        {
+            buttons[n - naxes] = ! buttons[n - naxes];
+            uinputEvent(fd, 1, n - naxes, buttons[n - naxes]);
+        }
+
+        now = start + i * 1000000 / rate;
+        sleepUntil(now);
+    }
+
+    free(buttons);
+    uinputDestroy(fd);
+    return 0;
+}
+
+static int synthDualShock4(const int rate, const int seconds)
+{
+    /* report ID 1 with 63 bytes of data, enough for nooice to treat it as a DS4 */
+    static const unsigned char desc[] = {
+        0x05, 0x01, 0x09, 0x05, 0xA1, 0x01, 0x85, 0x01,
+        0x06, 0x00, 0xFF, 0x09, 0x20, 0x15, 0x00, 0x26, 0xFF, 0x00,
+        0x75, 0x08, 0x95, 0x3F, 0x81, 0x02, 0xC0
+    };
+
+    const int fd = uhidCreate(0x054c, 0x05c4, desc, sizeof(desc));
+
+    if (fd < 0 || printHidrawPath() != 0)
+        return 1;
+
+    unsigned char report[64];
+    memset(report, 0, sizeof(report));
+    report[0] = 0x01;
+    report[1] = report[2] = report[3] = report[4] = 0x80;
+    report[5] = 0x08;
+
+    const uint64_t start = getTimeUsecs();
+    const uint64_t end   = seconds > 0 ? start + (uint64_t)seconds * 1000000 : UINT64_MAX;
+
+    for (uint64_t i = 1, now = start; gRunning && now < end; ++i)
+    {
+        /* sticks and triggers drift, buttons change now and then, the counter always changes */
+        const int axis = 1 + rand() % 4;
+        report[axis] += (rand() % 5) - 2;
+        if (rand() % 8 == 0)
+            report[8 + rand() % 2] = rand() % 256;
+
+        if (rand() % 16 == 0)
+            report[5] = (report[5] & 0x0F) | ((rand() % 16) << 4);
+        if (rand() % 16 == 0)
+            report[6] ^= 1 << (rand() % 8);
+
+        report[7] = (report[7] & 0x03) | ((i << 2) & 0xFC);
+
+        uhidInput(fd, report, sizeof(report));
+
+        now = start + i * 1000000 / rate;
+        sleepUntil(now);
+    }
+
+    uhidDestroy(fd);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s FILE [--loop]\n", argv[0]);
+        printf("       %s --joystick AXES BUTTONS RATE [SECONDS]\n", argv[0]);
+        printf("       %s --ds4 RATE [SECONDS]\n", argv[0]);
+        return 1;
+    }
+
+    struct sigaction sig;
+    memset(&sig, 0, sizeof(sig));
+    sig.sa_handler = signalHandler;
+    sigemptyset(&sig.sa_mask);
+    sigaction(SIGINT,  &sig, NULL);
+    sigaction(SIGTERM, &sig, NULL);
+
+    srand(getpid());
+
+    if (strcmp(argv[1], "--joystick") == 0)
+    {
+        if (argc < 5)
+            return 1;
+
+        int naxes = atoi(argv[2]), nbuttons = atoi(argv[3]);
+        const int rate = atoi(argv[4]);
+
+        if (naxes < 1 || naxes > MAX_AXES)
+            naxes = naxes < 1 ? 1 : MAX_AXES;
+        if (nbuttons < 1 || nbuttons > MAX_BUTTONS)
+            nbuttons = nbuttons < 1 ? 1 : MAX_BUTTONS;
+
+        return synthJoystick(naxes, nbuttons, rate > 0 ? rate : 100, argc > 5 ? atoi(argv[5]) : 0);
+    }
+
+    if (strcmp(argv[1], "--ds4") == 0)
+    {
+        if (argc < 3)
+            return 1;
+
+        const int rate = atoi(argv[2]);
+
+        return synthDualShock4(rate > 0 ? rate : 250, argc > 3 ? atoi(argv[3]) : 0);
+    }
+
+    return replayFile(argv[1], argc > 2 && strcmp(argv[2], "--loop") == 0);
+}
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+# nooice - per-report latency from a trace of a TRACE=true build
+#
+# Capture with ftrace, for example:
+#   echo 1 > /sys/kernel/tracing/events/sched/sched_switch/enable   (optional, for the scheduler timeline)
+#   echo > /sys/kernel/tracing/trace; sleep 10; cat /sys/kernel/tracing/trace > trace.txt
+# or "trace-cmd record -e sched_switch" followed by "trace-cmd report > trace.txt".
+#
+# Each report is followed from the reader (report_read, publish) to the first process cycle that
+# decoded it (midi), the latency printed is the time between report_read and that cycle's midi.
+
+import re
+import sys
+
+LINE_RE = re.compile(r'\s(\d+\.\d+):.*?\b(nooice\d+) (\w+) (\d+) (\d+)\s*$')
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100.0))]
+
+def main(args):
+    if len(args) < 1 or args[0] in ('-h', '--help'):
+        print("Usage: %s trace.txt [--csv]" % sys.argv[0])
+        return 1
+
+    csv = '--csv' in args[1:]
+
+    # per client state
+    reads     = {} # client -> {seq: timestamp}
+    published = {} # client -> [(generation, seq)], in order
+    latencies = {} # client -> [(seq, generation, latency in us, events)]
+    skipped   = {} # client -> reports dropped as identical to the previous one
+
+    with open(args[0]) as fh:
+        for line in fh:
+            m = LINE_RE.search(line)
+            if m is None:
+                continue
+
+            ts, client, name, a, b = float(m.group(1)), m.group(2), m.group(3), int(m.group(4)), int(m.group(5))
+
+            if name == 'report_read':
+                reads.setdefault(client, {})[a] = ts
+                skipped[client] = skipped.get(client, 0) + 1
+
+            elif name == 'publish':
+                published.setdefault(client, []).append((b, a))
+                skipped[client] -= 1
+
+            elif name == 'midi':
+                pending = published.get(client, [])
+                done = [p for p in pending if p[0] <= a]
+                published[client] = [p for p in pending if p[0] > a]
+
+                for generation, seq in done:
+                    read_ts = reads.get(client, {}).pop(seq, None)
+                    if read_ts is None:
+                        continue
+                    latencies.setdefault(client, []).append((seq, generation, (ts - read_ts) * 1e6, b))
+
+    if csv:
+        print("client,seq,generation,latency_us,events")
+        for client in sorted(latencies):
+            for seq, generation, latency, events in latencies[client]:
+                print("%s,%d,%d,%.1f,%d" % (client, seq, generation, latency, events))
+        return 0
+
+    for client in sorted(set(reads) | set(latencies)):
+        values = [l[2] for l in latencies.get(client, [])]
+        print("%s: %d reports decoded, %d skipped as unchanged" % (client, len(values), skipped.get(client, 0)))
+        if values:
+            print("  latency us: min %.1f, avg %.1f, p50 %.1f, p99 %.1f, max %.1f" % (
+                min(values), sum(values) / len(values), percentile(values, 50), percentile(values, 99), max(values)))
+
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
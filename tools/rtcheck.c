@@ -0,0 +1,473 @@
+/*
+ * nooice - ...
+ * Copyright (C) 2016-2017 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * RT-safety checker, to be preloaded into a "make rtcheck" build of nooice:
+ *   LD_PRELOAD=tools/nooice-rtcheck.so ./nooice-rtcheck /dev/hidraw0
+ * or into jackd when using nooice-rtcheck.so as internal client.
+ *
+ * nooice marks each process cycle with nooice_rtcheck_enter/leave.
+ * Any allocation, blocking lock, sleep or I/O call made on that thread during a cycle is reported with a backtrace.
+ * Set NOOICE_RTCHECK_ABORT=1 to abort on the first one, so it can be inspected in a debugger or core dump.
+ */
+
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/select.h>
+
+/* glibc allocator entry points, used so that dlsym itself can allocate */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+extern void  __libc_free(void* ptr);
+
+static __thread int tInCycle;
+static __thread int tReporting;
+
+static unsigned long gCycles;
+static unsigned long gViolations;
+static int gAbort;
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+
+static ssize_t (*real_read)(int, void*, size_t);
+static ssize_t (*real_write)(int, const void*, size_t);
+static int (*real_open)(const char*, int, ...);
+static int (*real_open64)(const char*, int, ...);
+static int (*real_openat)(int, const char*, int, ...);
+static int (*real_close)(int);
+static int (*real_poll)(struct pollfd*, nfds_t, int);
+static int (*real_select)(int, fd_set*, fd_set*, fd_set*, struct timeval*);
+static int (*real_nanosleep)(const struct timespec*, struct timespec*);
+static int (*real_clock_nanosleep)(clockid_t, int, const struct timespec*, struct timespec*);
+static int (*real_usleep)(useconds_t);
+static unsigned (*real_sleep)(unsigned);
+static int (*real_pthread_mutex_lock)(pthread_mutex_t*);
+static int (*real_pthread_cond_wait)(pthread_cond_t*, pthread_mutex_t*);
+static int (*real_pthread_cond_timedwait)(pthread_cond_t*, pthread_mutex_t*, const struct timespec*);
+static int (*real_pthread_join)(pthread_t, void**);
+static int (*real_sem_wait)(sem_t*);
+static int (*real_sem_timedwait)(sem_t*, const struct timespec*);
+static int (*real_vfprintf)(FILE*, const char*, va_list);
+static int (*real_fputs)(const char*, FILE*);
+static int (*real_puts)(const char*);
+static size_t (*real_fwrite)(const void*, size_t, size_t, FILE*);
+
+static void* lookup(const char* const name)
+{
+    void* const ptr = dlsym(RTLD_NEXT, name);
+
+    if (ptr == NULL)
+    {
+        fprintf(stderr, "nooice-rtcheck: failed to find symbol \"%s\"\n", name);
+        abort();
+    }
+
+    return ptr;
+}
+
+/* pthread_cond_* have an old ABI version, which dlsym may return instead of the default one */
+static void* lookupCond(const char* const name)
+{
+    void* const ptr = dlvsym(RTLD_NEXT, name, "GLIBC_2.3.2");
+
+    return ptr != NULL ? ptr : lookup(name);
+}
+
+__attribute__((constructor))
+static void rtcheckInit(void)
+{
+    real_read                   = lookup("read");
+    real_write                  = lookup("write");
+    real_open                   = lookup("open");
+    real_open64                 = lookup("open64");
+    real_openat                 = lookup("openat");
+    real_close                  = lookup("close");
+    real_poll                   = lookup("poll");
+    real_select                 = lookup("select");
+    real_nanosleep              = lookup("nanosleep");
+    real_clock_nanosleep        = lookup("clock_nanosleep");
+    real_usleep                 = lookup("usleep");
+    real_sleep                  = lookup("sleep");
+    real_pthread_mutex_lock     = lookup("pthread_mutex_lock");
+    real_pthread_cond_wait      = lookupCond("pthread_cond_wait");
+    real_pthread_cond_timedwait = lookupCond("pthread_cond_timedwait");
+    real_pthread_join           = lookup("pthread_join");
+    real_sem_wait               = lookup("sem_wait");
+    real_sem_timedwait          = lookup("sem_timedwait");
+    real_vfprintf               = lookup("vfprintf");
+    real_fputs                  = lookup("fputs");
+    real_puts                   = lookup("puts");
+    real_fwrite                 = lookup("fwrite");
+
+    /* the first backtrace() call loads libgcc, do it now instead of during a report */
+    void* frames[1];
+    backtrace(frames, 1);
+
+    const char* const abortenv = getenv("NOOICE_RTCHECK_ABORT");
+    gAbort = abortenv != NULL && atoi(abortenv) != 0;
+}
+
+__attribute__((destructor))
+static void rtcheckFini(void)
+{
+    char msg[128];
+    const int len = snprintf(msg, sizeof(msg), "nooice-rtcheck: %lu violations in %lu process cycles\n",
+                             __atomic_load_n(&gViolations, __ATOMIC_RELAXED),
+                             __atomic_load_n(&gCycles, __ATOMIC_RELAXED));
+
+    if (len > 0 && real_write != NULL)
+        real_write(STDERR_FILENO, msg, len);
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+
+void nooice_rtcheck_enter(void)
+{
+    tInCycle = 1;
+    __atomic_add_fetch(&gCycles, 1, __ATOMIC_RELAXED);
+}
+
+void nooice_rtcheck_leave(void)
+{
+    tInCycle = 0;
+}
+
+static void violation(const char* const name)
+{
+    if (! tInCycle || tReporting)
+        return;
+
+    tReporting = 1;
+
+    const unsigned long count = __atomic_add_fetch(&gViolations, 1, __ATOMIC_RELAXED);
+
+    char msg[128];
+    const int len = snprintf(msg, sizeof(msg), "nooice-rtcheck: violation #%lu, %s() called from the process thread\n",
+                             count, name);
+
+    if (len > 0)
+        real_write(STDERR_FILENO, msg, len);
+
+    void* frames[32];
+    const int nframes = backtrace(frames, 32);
+
+    /* skip ourselves */
+    if (nframes > 1)
+        backtrace_symbols_fd(frames + 1, nframes - 1, STDERR_FILENO);
+
+    if (gAbort)
+        abort();
+
+    tReporting = 0;
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+/* memory */
+
+void* malloc(size_t size)
+{
+    violation("malloc");
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t nmemb, size_t size)
+{
+    violation("calloc");
+    return __libc_calloc(nmemb, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    violation("realloc");
+    return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+    violation("memalign");
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+    violation("aligned_alloc");
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size)
+{
+    violation("posix_memalign");
+
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0)
+        return 22; /* EINVAL */
+
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr != NULL ? 0 : 12; /* ENOMEM */
+}
+
+void free(void* ptr)
+{
+    if (ptr != NULL)
+        violation("free");
+    __libc_free(ptr);
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+/* syscalls */
+
+ssize_t read(int fd, void* buf, size_t count)
+{
+    violation("read");
+    return real_read(fd, buf, count);
+}
+
+ssize_t __read_chk(int fd, void* buf, size_t count, size_t buflen)
+{
+    (void)buflen;
+    violation("read");
+    return real_read(fd, buf, count);
+}
+
+ssize_t write(int fd, const void* buf, size_t count)
+{
+    violation("write");
+    return real_write(fd, buf, count);
+}
+
+int open(const char* path, int flags, ...)
+{
+    mode_t mode = 0;
+
+    if (flags & (O_CREAT|O_TMPFILE))
+    {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+
+    violation("open");
+    return real_open(path, flags, mode);
+}
+
+int open64(const char* path, int flags, ...)
+{
+    mode_t mode = 0;
+
+    if (flags & (O_CREAT|O_TMPFILE))
+    {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+
+    violation("open64");
+    return real_open64(path, flags, mode);
+}
+
+int openat(int dirfd, const char* path, int flags, ...)
+{
+    mode_t mode = 0;
+
+    if (flags & (O_CREAT|O_TMPFILE))
+    {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+
+    violation("openat");
+    return real_openat(dirfd, path, flags, mode);
+}
+
+int close(int fd)
+{
+    violation("close");
+    return real_close(fd);
+}
+
+int poll(struct pollfd* fds, nfds_t nfds, int timeout)
+{
+    violation("poll");
+    return real_poll(fds, nfds, timeout);
+}
+
+int select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval* timeout)
+{
+    violation("select");
+    return real_select(nfds, readfds, writefds, exceptfds, timeout);
+}
+
+int nanosleep(const struct timespec* req, struct timespec* rem)
+{
+    violation("nanosleep");
+    return real_nanosleep(req, rem);
+}
+
+int clock_nanosleep(clockid_t clockid, int flags, const struct timespec* req, struct timespec* rem)
+{
+    violation("clock_nanosleep");
+    return real_clock_nanosleep(clockid, flags, req, rem);
+}
+
+int usleep(useconds_t usec)
+{
+    violation("usleep");
+    return real_usleep(usec);
+}
+
+unsigned sleep(unsigned seconds)
+{
+    violation("sleep");
+    return real_sleep(seconds);
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+/* blocking thread calls, pthread_mutex_trylock is fine */
+
+int pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+    violation("pthread_mutex_lock");
+    return real_pthread_mutex_lock(mutex);
+}
+
+int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex)
+{
+    violation("pthread_cond_wait");
+    return real_pthread_cond_wait(cond, mutex);
+}
+
+int pthread_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, const struct timespec* abstime)
+{
+    violation("pthread_cond_timedwait");
+    return real_pthread_cond_timedwait(cond, mutex, abstime);
+}
+
+int pthread_join(pthread_t thread, void** retval)
+{
+    violation("pthread_join");
+    return real_pthread_join(thread, retval);
+}
+
+int sem_wait(sem_t* sem)
+{
+    violation("sem_wait");
+    return real_sem_wait(sem);
+}
+
+int sem_timedwait(sem_t* sem, const struct timespec* abstime)
+{
+    violation("sem_timedwait");
+    return real_sem_timedwait(sem, abstime);
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
+/* stdio, which locks and may allocate or write */
+
+int vfprintf(FILE* stream, const char* format, va_list args)
+{
+    violation("vfprintf");
+    return real_vfprintf(stream, format, args);
+}
+
+int vprintf(const char* format, va_list args)
+{
+    violation("vprintf");
+    return real_vfprintf(stdout, format, args);
+}
+
+int fprintf(FILE* stream, const char* format, ...)
+{
+    violation("fprintf");
+
+    va_list args;
+    va_start(args, format);
+    const int ret = real_vfprintf(stream, format, args);
+    va_end(args);
+    return ret;
+}
+
+int printf(const char* format, ...)
+{
+    violation("printf");
+
+    va_list args;
+    va_start(args, format);
+    const int ret = real_vfprintf(stdout, format, args);
+    va_end(args);
+    return ret;
+}
+
+/* what the above become with _FORTIFY_SOURCE, the default on several distributions */
+int __fprintf_chk(FILE* stream, int flag, const char* format, ...)
+{
+    (void)flag;
+    violation("fprintf");
+
+    va_list args;
+    va_start(args, format);
+    const int ret = real_vfprintf(stream, format, args);
+    va_end(args);
+    return ret;
+}
+
+int __printf_chk(int flag, const char* format, ...)
+{
+    (void)flag;
+    violation("printf");
+
+    va_list args;
+    va_start(args, format);
+    const int ret = real_vfprintf(stdout, format, args);
+    va_end(args);
+    return ret;
+}
+
+int fputs(const char* str, FILE* stream)
+{
+    violation("fputs");
+    return real_fputs(str, stream);
+}
+
+int puts(const char* str)
+{
+    violation("puts");
+    return real_puts(str);
+}
+
+size_t fwrite(const void* ptr, size_t size, size_t nmemb, FILE* stream)
+{
+    violation("fwrite");
+    return real_fwrite(ptr, size, nmemb, stream);
+}
+
+/* ------------------------------------------------------------------------------------------------------------------ */
@@ -0,0 +1,83 @@
+#!/bin/bash
+# nooice - run the RT-safety checking build against virtual devices
+# Needs "make rtcheck" first, and access to /dev/uhid and /dev/uinput (usually root).
+#
+# Usage: tools/rtcheck.sh [SECONDS] [replay files...]
+# Starts a dummy jackd if no server is running, then runs nooice-rtcheck on each workload.
+# Exits with non-zero status if any workload had RT-safety violations.
+
+set -e
+
+cd "$(dirname "${0}")/.."
+
+SECONDS_PER_RUN=${1:-10}
+shift || true
+
+if [ ! -x nooice-rtcheck ] || [ ! -f tools/nooice-rtcheck.so ] || [ ! -x tools/nooice-replay ]; then
+    echo "please run 'make rtcheck' first"
+    exit 1
+fi
+
+JACKD_PID=""
+REPLAY_PID=""
+FAILED=0
+
+cleanup() {
+    [ -n "${REPLAY_PID}" ] && kill "${REPLAY_PID}" 2>/dev/null || true
+    [ -n "${JACKD_PID}" ] && kill "${JACKD_PID}" 2>/dev/null || true
+    rm -f "${TMPOUT}"
+}
+trap cleanup EXIT
+
+TMPOUT=$(mktemp)
+
+if ! jack_lsp >/dev/null 2>&1; then
+    jackd -n nooice-rtcheck -d dummy -r 48000 -p 64 >/dev/null 2>&1 &
+    JACKD_PID=$!
+    export JACK_DEFAULT_SERVER=nooice-rtcheck
+    sleep 2
+fi
+
+# run_workload NAME replay-args...
+run_workload() {
+    local name="${1}"
+    shift
+
+    coproc REPLAY { exec tools/nooice-replay "$@"; }
+
+    local device=""
+    read -r -t 5 device <&"${REPLAY[0]}" || true
+
+    if [ -z "${device}" ]; then
+        echo "${name}: failed to create virtual device"
+        FAILED=1
+        kill "${REPLAY_PID}" 2>/dev/null || true
+        wait "${REPLAY_PID}" 2>/dev/null || true
+        return
+    fi
+
+    LD_PRELOAD="${PWD}/tools/nooice-rtcheck.so" ./nooice-rtcheck "${device}" >/dev/null 2>"${TMPOUT}" &
+    local nooice_pid=$!
+
+    sleep "${SECONDS_PER_RUN}"
+    kill "${REPLAY_PID}" 2>/dev/null || true
+    wait "${REPLAY_PID}" 2>/dev/null || true
+    kill -INT "${nooice_pid}" 2>/dev/null || true
+    wait "${nooice_pid}" 2>/dev/null || true
+
+    echo "${name}: $(grep 'process cycles' "${TMPOUT}" || echo 'no summary, nooice-rtcheck did not exit cleanly')"
+
+    if grep -q 'nooice-rtcheck: violation' "${TMPOUT}"; then
+        grep -A 32 'nooice-rtcheck: violation' "${TMPOUT}" | head -n 200
+        FAILED=1
+    fi
+}
+
+run_workload "generic joystick" --joystick 32 64 1000
+run_workload "dualshock 4"      --ds4 250
+
+for file in "$@"; do
+    run_workload "${file}" "${file}" --loop
+done
+
+exit ${FAILED}
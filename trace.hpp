@@ -0,0 +1,135 @@
+/*
+ * nooice - ...
+ * Copyright (C) 2016-2017 Filipe Coelho <falktx@falktx.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose with
+ * or without fee is hereby granted, provided that the above copyright notice and this
+ * permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH REGARD
+ * TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS. IN
+ * NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ * DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef NOOICE_TRACE_HPP_INCLUDED
+#define NOOICE_TRACE_HPP_INCLUDED
+
+// --------------------------------------------------------------------------------------------------------------------
+// Optional tracepoints, enabled by building with TRACE=true
+// Each one writes "nooiceN name a b" to the ftrace trace_marker, and is also a USDT probe if sys/sdt.h is available.
+// See tools/nooice-trace-latency.py
+
+#ifdef NOOICE_TRACING
+
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__has_include)
+# if __has_include(<sys/sdt.h>)
+#  include <sys/sdt.h>
+#  define NOOICE_TRACE_USDT(name, id, a, b) DTRACE_PROBE3(nooice, name, id, a, b)
+# endif
+#endif
+
+#ifndef NOOICE_TRACE_USDT
+# define NOOICE_TRACE_USDT(name, id, a, b)
+#endif
+
+static int gTraceFd = -1;
+
+static inline
+void traceInit()
+{
+    if (gTraceFd >= 0)
+        return;
+
+    // writes must never block the process thread
+    gTraceFd = open("/sys/kernel/tracing/trace_marker", O_WRONLY|O_NONBLOCK|O_CLOEXEC);
+
+    if (gTraceFd < 0)
+        gTraceFd = open("/sys/kernel/debug/tracing/trace_marker", O_WRONLY|O_NONBLOCK|O_CLOEXEC);
+
+    if (gTraceFd < 0)
+        fprintf(stderr, "nooice:: failed to open trace_marker, only USDT probes will be available\n");
+}
+
+static inline
+void traceMarker(const char* const name, const int id, const unsigned a, const unsigned b) noexcept
+{
+    if (gTraceFd < 0)
+        return;
+
+    char msg[64];
+    const int len = std::snprintf(msg, sizeof(msg), "nooice%i %s %u %u\n", id, name, a, b);
+
+    if (len > 0 && write(gTraceFd, msg, len) < 0) {}
+}
+
+# define NOOICE_TRACE_INIT() traceInit()
+# define NOOICE_TRACE(name, id, a, b) \
+    do { NOOICE_TRACE_USDT(name, id, a, b); traceMarker(#name, id, a, b); } while (0)
+
+#else
+
+// arguments are not evaluated
+# define NOOICE_TRACE_INIT()
+# define NOOICE_TRACE(name, id, a, b) \
+    do { (void)sizeof(id); (void)sizeof(a); (void)sizeof(b); } while (0)
+
+#endif // NOOICE_TRACING
+
+// --------------------------------------------------------------------------------------------------------------------
+// RT-safety checks, enabled by "make rtcheck"
+// Marks the process cycle for tools/nooice-rtcheck.so, which reports allocations, locks and syscalls made inside it.
+
+#ifdef NOOICE_RTCHECK
+
+#include <cstdio>
+
+#include <dlfcn.h>
+
+static void (*gRtCheckEnter)() = nullptr;
+static void (*gRtCheckLeave)() = nullptr;
+
+static inline
+void rtcheckInit()
+{
+    gRtCheckEnter = (void (*)())dlsym(RTLD_DEFAULT, "nooice_rtcheck_enter");
+    gRtCheckLeave = (void (*)())dlsym(RTLD_DEFAULT, "nooice_rtcheck_leave");
+
+    if (gRtCheckEnter == nullptr || gRtCheckLeave == nullptr)
+        fprintf(stderr, "nooice:: tools/nooice-rtcheck.so is not preloaded, nothing will be checked\n");
+}
+
+struct RtCheckScope {
+    RtCheckScope() noexcept
+    {
+        if (gRtCheckEnter != nullptr)
+            gRtCheckEnter();
+    }
+
+    ~RtCheckScope() noexcept
+    {
+        if (gRtCheckLeave != nullptr)
+            gRtCheckLeave();
+    }
+};
+
+# define NOOICE_RTCHECK_INIT() rtcheckInit()
+# define NOOICE_RTCHECK_SCOPE() const RtCheckScope rtcheckScope
+
+#else
+
+# define NOOICE_RTCHECK_INIT()
+# define NOOICE_RTCHECK_SCOPE()
+
+#endif // NOOICE_RTCHECK
+
+// --------------------------------------------------------------------------------------------------------------------
+
+#endif // NOOICE_TRACE_HPP_INCLUDED